@@ -1,6 +1,10 @@
 #include "virtual.h"
 #include "fbv.h"
 #include "tick.h"
+#include "serial.h"
+#include "fbvmap.h"
+#include "io.h"
+#include "timer.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -12,67 +16,119 @@
 #define VIRTUAL_STARTUP_TIME 3000
 #define VIRTUAL_CYCLE_INTERVAL 10
 
-#define VIRTUAL_RXSTATE_INITIAL 0
-#define VIRTUAL_RXSTATE_LEN 1
-#define VIRTUAL_RXSTATE_CMD 2
-#define VIRTUAL_RXSTATE_PRM 3
 #define VIRTUAL_MAX_BUFFER 128
 
 #define VIRTUAL_MIDI_RX_CMD 0
 #define VIRTUAL_MIDI_RX_CCPC 1
 #define VIRTUAL_MIDI_RX_VAL 2
 
-#define BUFFER_LEN_OFFSET 0
-#define BUFFER_CMD_OFFSET 1
-#define BUFFER_PRM_OFFSET 2
-
 #define MIDI_IS_CC(byte) ((byte & 0xF0) == 0xB0)
 #define MIDI_IS_PC(byte) ((byte & 0xF0) == 0xC0)
 
 // default program is 1A
 #define VIRTUAL_DEFAULT_PROGRAM 1
 
-#define VIRTUAL_FX_EQ 0x1
-#define VIRTUAL_FX_MOD 0x2
-#define VIRTUAL_FX_STOMP 0x4
-#define VIRTUAL_FX_DLY 0x8
-#define VIRTUAL_FX_AMP 0x10
-#define VIRTUAL_FX_GATE 0x20
-#define VIRTUAL_FX_WAH 0x40
-#define VIRTUAL_FX_COUNT 7
-
-#define VIRTUAL_FX_EQ_IDX 0
-#define VIRTUAL_FX_MOD_IDX 1
-#define VIRTUAL_FX_STOMP_IDX 2
-#define VIRTUAL_FX_DLY_IDX 3
-#define VIRTUAL_FX_AMP_IDX 4
-#define VIRTUAL_FX_GATE_IDX 5
-#define VIRTUAL_FX_WAH_IDX 6
+// FX bits follow the shared FBV LED mapping
+#define VIRTUAL_FX_EQ (1<<POD_FX_EQ)
+#define VIRTUAL_FX_MOD (1<<POD_FX_MOD)
+#define VIRTUAL_FX_STOMP (1<<POD_FX_STOMP)
+#define VIRTUAL_FX_DLY (1<<POD_FX_DLY)
+#define VIRTUAL_FX_AMP (1<<POD_FX_AMP)
+#define VIRTUAL_FX_GATE (1<<POD_FX_GATE)
+#define VIRTUAL_FX_WAH (1<<POD_FX_WAH)
+#define VIRTUAL_FX_COUNT POD_FX_COUNT
+
+#define VIRTUAL_FX_EQ_IDX POD_FX_EQ
+#define VIRTUAL_FX_MOD_IDX POD_FX_MOD
+#define VIRTUAL_FX_STOMP_IDX POD_FX_STOMP
+#define VIRTUAL_FX_DLY_IDX POD_FX_DLY
+#define VIRTUAL_FX_AMP_IDX POD_FX_AMP
+#define VIRTUAL_FX_GATE_IDX POD_FX_GATE
+#define VIRTUAL_FX_WAH_IDX POD_FX_WAH
 
 typedef struct virtual_pod_s {
   uint32_t flags;
-  tick_t lastCycle;
-  uint8_t fbvRxState;
-  uint8_t fbvPendingBytes;
-  uint8_t fbvWrPtr;
-  uint8_t fbvRxBuffer[VIRTUAL_MAX_BUFFER];
+  Timer startup;
+  Timer cycle;
+  FBVContext fbvLink;
+  FBVMessage fbvRxMsg;
   uint8_t fbvTxBuffer[VIRTUAL_MAX_BUFFER];
   uint8_t txSize;
   uint8_t midiRxState;
   uint8_t midiRxBuffer[3];
+  uint8_t midiInSysex;
+  uint16_t midiSysexSize;
+  uint8_t seqNext;
   uint8_t currentProgram;
   uint32_t fxStates;
+  uint8_t tempoMsb;
+  uint16_t tempo;
 } VirtualPOD;
 
+// press to light latency: from a scripted switch going down to the next
+// change of the LEDs
+typedef struct virtual_leds_s {
+  uint32_t btnStates;
+  // the switches pressed at pressAt
+  uint32_t pressed;
+  uint32_t states;
+  uint64_t pressAt;
+  uint32_t count;
+  uint32_t max;
+  uint64_t total;
+  // GPIO writes of the LED driver
+  uint32_t pinWrites;
+} VirtualLEDs;
+
+// bus writes of the LCD driver, which only writes what changed
+typedef struct virtual_lcd_s {
+  LCDContents shown;
+  uint32_t draws;
+} VirtualLCD;
+
+// incoming MIDI clock measured against the tempo the POD was set to
+typedef struct virtual_clock_s {
+  uint64_t start;
+  uint64_t last;
+  uint32_t pulses;
+  uint32_t maxJitter;
+} VirtualClock;
+
 typedef struct program_info_s {
   char text[16];
   uint32_t fxStates;
 } ProgramInfo;
 
+// scripted footswitch activity, states hold until the next entry
+typedef struct virtual_btn_event_s {
+  tick_t time;
+  uint32_t states;
+} VirtualButtonEvent;
+
+// scripted expression pedal sweep from 0 to 127
+typedef struct virtual_exp_sweep_s {
+  tick_t start;
+  tick_t duration;
+} VirtualExpSweep;
+
+// an external sequencer on MIDI in, merged into what we send the POD
+typedef struct virtual_seq_event_s {
+  tick_t time;
+  uint8_t size;
+  uint8_t bytes[12];
+} VirtualSeqEvent;
+
 static VirtualPOD pod;
+static VirtualClock midiClock;
+static VirtualLEDs leds;
+static VirtualLCD lcd;
 const static uint8_t pod_ping[4] = {0xF0, 0x02, 0x01, 0x00};
 
 #define VIRTUAL_PROGRAM_COUNT 5
+// parameter bytes in a patch dump; the whole dump with the program
+// change in front of it
+#define VIRTUAL_DUMP_PARAMS 96
+#define VIRTUAL_DUMP_SIZE (2 + 7 + 16 + 2 + VIRTUAL_DUMP_PARAMS + 1 + 1)
 static const ProgramInfo programs[VIRTUAL_PROGRAM_COUNT] = {
     {"Manual          ", 0x00},
     {"Program 1       ", (VIRTUAL_FX_EQ | VIRTUAL_FX_MOD | VIRTUAL_FX_AMP)},
@@ -80,24 +136,71 @@ static const ProgramInfo programs[VIRTUAL_PROGRAM_COUNT] = {
     {"Program 3       ", (VIRTUAL_FX_WAH | VIRTUAL_FX_AMP)},
     {"Program 4       ", (VIRTUAL_FX_GATE | VIRTUAL_FX_AMP | VIRTUAL_FX_STOMP | VIRTUAL_FX_EQ | VIRTUAL_FX_MOD)}};
 
-static const FBVLED led_mapping[VIRTUAL_FX_COUNT] =
-  {
-   FBV_LED_SB2,
-   FBV_LED_MOD,
-   FBV_LED_SB1,
-   FBV_LED_DLY,
-   FBV_LED_AMP,
-   FBV_LED_SB3,
-   FBV_LED_WAH
-  };
-
-static const FBVLED ch_led_mapping[4] =
-  {
-   FBV_LED_CHA,
-   FBV_LED_CHB,
-   FBV_LED_CHC,
-   FBV_LED_CHD
-  };
+#define VIRTUAL_BTN(btn) (1<<(btn))
+// switches that light something; the delay LED also blinks the tempo by
+// itself, that only counts when DLY was pressed
+#define VIRTUAL_LED_BTNS (VIRTUAL_BTN(BTN_CHA) | VIRTUAL_BTN(BTN_CHB) | VIRTUAL_BTN(BTN_CHC) | \
+                          VIRTUAL_BTN(BTN_CHD) | VIRTUAL_BTN(BTN_EQ) | VIRTUAL_BTN(BTN_STOMP) | \
+                          VIRTUAL_BTN(BTN_MOD) | VIRTUAL_BTN(BTN_DLY) | VIRTUAL_BTN(BTN_WAH))
+#define VIRTUAL_LED_TAP (1<<(FBVMAP_CHANNEL_COUNT + POD_FX_DLY))
+// the bank switches held together record what follows, then play it
+// back; the tap switch is held for the tuner at the end
+static const VirtualButtonEvent btn_script[] = {
+    {4300, VIRTUAL_BTN(BTN_UP) | VIRTUAL_BTN(BTN_DN)},
+    {4900, 0},
+    {5000, VIRTUAL_BTN(BTN_MOD)},
+    {5200, 0},
+    {6000, VIRTUAL_BTN(BTN_CHB)},
+    {6200, 0},
+    {6500, VIRTUAL_BTN(BTN_TAP)},
+    {6560, 0},
+    {7000, VIRTUAL_BTN(BTN_TAP)},
+    {7060, 0},
+    {7140, VIRTUAL_BTN(BTN_TAP)},
+    {7200, 0},
+    {7520, VIRTUAL_BTN(BTN_TAP)},
+    {7580, 0},
+    {8000, VIRTUAL_BTN(BTN_CHA)},
+    {8200, 0},
+    {8600, VIRTUAL_BTN(BTN_CHA)},
+    {8800, 0},
+    {9000, VIRTUAL_BTN(BTN_DN)},
+    {9040, VIRTUAL_BTN(BTN_UP) | VIRTUAL_BTN(BTN_DN)},
+    {9700, 0},
+    {13000, VIRTUAL_BTN(BTN_TAP)},
+    {13800, 0},
+    {14500, VIRTUAL_BTN(BTN_CHC)},
+    {14700, 0},
+    // browses to bank 2, which the virtual POD doesn't have; loaded when
+    // left alone, its program is rolled back
+    {15000, VIRTUAL_BTN(BTN_UP)},
+    {15200, 0},
+    // scroll up to the last bank and back, then pick a channel: one
+    // program change
+    {17500, VIRTUAL_BTN(BTN_UP)},
+    {19900, 0},
+    {20200, VIRTUAL_BTN(BTN_DN)},
+    {22600, 0},
+    {22900, VIRTUAL_BTN(BTN_CHD)},
+    {23100, 0}};
+#define VIRTUAL_BTN_SCRIPT_LEN (sizeof(btn_script)/sizeof(VirtualButtonEvent))
+
+static const VirtualSeqEvent seq_script[] = {
+    // volume in running status, on the line as the MOD switch is pressed
+    {4990, 7, {0xB0, 0x07, 0x40, 0x07, 0x48, 0x07, 0x50}},
+    // a note on another channel, the POD ignores it
+    {5000, 3, {0x92, 0x3C, 0x40}},
+    // SysEx with a clock pulse and active sensing inside
+    {5010, 12, {0xF0, 0x00, 0x01, 0x0C, 0xF8, 0x7E, 0x01, 0xFE, 0x02, 0x03, 0x04, 0xF7}},
+    {5600, 2, {0xC0, 0x04}},
+    // SysEx cut short by a control change
+    {5800, 9, {0xF0, 0x00, 0x01, 0x0C, 0x05, 0xB0, 0x07, 0x60, 0xFE}}};
+
+#define VIRTUAL_SEQ_SCRIPT_LEN (sizeof(seq_script)/sizeof(VirtualSeqEvent))
+
+static const VirtualExpSweep exp_script[2] = {
+    {9000, 1000},
+    {9500, 1000}};
 
 static void _dump_packet(uint8_t *packet, uint8_t size) {
   unsigned int i = 0;
@@ -108,7 +211,7 @@ static void _dump_packet(uint8_t *packet, uint8_t size) {
 
 static void _fbv_tx(uint8_t byte) {
   // send bytes back
-  FBV_recv_byte(byte);
+  SERIAL_fbv_inject(byte);
 }
 
 static void _fbv_tx_many(uint8_t *bytes, uint8_t size) {
@@ -126,6 +229,49 @@ static void _fbv_queue_tx(uint8_t *bytes, uint8_t size) {
   pod.flags |= VIRTUAL_FLAG_PACKET_TX;
 }
 
+// MIDI out of the POD, delivered at line rate
+static void _midi_tx_many(const uint8_t* bytes, unsigned int count) {
+  unsigned int i = 0;
+  if (MIDI_MERGE_ENABLE) {
+    // MIDI in carries the sequencer, the POD's out isn't connected
+    return;
+  }
+  for (i = 0; i < count; i++) {
+    SERIAL_midi_inject(bytes[i]);
+  }
+}
+
+// program change followed by a patch dump: Line 6 id, POD xt device,
+// dump command, program, 16 name bytes, FX states as two 7 bit bytes,
+// then opaque parameter data. An active sensing byte is slipped in
+// mid-dump, as MIDI allows
+static void _midi_send_dump(uint8_t program) {
+  uint8_t sendBuffer[VIRTUAL_DUMP_SIZE];
+  unsigned int i = 0, count = 0;
+
+  sendBuffer[count++] = 0xC0;
+  sendBuffer[count++] = program;
+  sendBuffer[count++] = 0xF0;
+  sendBuffer[count++] = 0x00;
+  sendBuffer[count++] = 0x01;
+  sendBuffer[count++] = 0x0C;
+  sendBuffer[count++] = 0x03;
+  sendBuffer[count++] = 0x71;
+  sendBuffer[count++] = program;
+  memcpy(sendBuffer + count, programs[program].text, 16);
+  count += 16;
+  sendBuffer[count++] = programs[program].fxStates & 0x7F;
+  sendBuffer[count++] = (programs[program].fxStates >> 7) & 0x7F;
+  for (i = 0; i < VIRTUAL_DUMP_PARAMS; i++) {
+    if (i == VIRTUAL_DUMP_PARAMS / 2) {
+      sendBuffer[count++] = 0xFE;
+    }
+    sendBuffer[count++] = (program + i) & 0x7F;
+  }
+  sendBuffer[count++] = 0xF7;
+  _midi_tx_many(sendBuffer, count);
+}
+
 static void _load_program(uint8_t program) {
   uint8_t sendBuffer[128];
   unsigned int i = 0, count = 0;
@@ -166,7 +312,7 @@ static void _load_program(uint8_t program) {
     sendBuffer[count++] = 0xF0;
     sendBuffer[count++] = 0x03;
     sendBuffer[count++] = 0x04;
-    sendBuffer[count++] = ch_led_mapping[(program-1)%4];
+    sendBuffer[count++] = FBVMAP_CHANNEL_LEDS[(program-1)%4];
     sendBuffer[count++] = 0x01;
   }
 
@@ -175,7 +321,8 @@ static void _load_program(uint8_t program) {
     sendBuffer[count++] = 0xF0;
     sendBuffer[count++] = 0x03;
     sendBuffer[count++] = 0x04;
-    sendBuffer[count++] = ch_led_mapping[(pod.currentProgram-1)%4];
+    sendBuffer[count++] = FBVMAP_CHANNEL_LEDS[(pod.currentProgram-1)%4];
+    sendBuffer[count++] = 0x00;
   }
 
   for (i = 0; i < VIRTUAL_FX_COUNT; i++) {
@@ -184,7 +331,7 @@ static void _load_program(uint8_t program) {
       sendBuffer[count++] = 0xF0;
       sendBuffer[count++] = 0x03;
       sendBuffer[count++] = 0x04;
-      sendBuffer[count++] = led_mapping[i];
+      sendBuffer[count++] = FBVMAP_FX_LEDS[i];
       if ((programs[program].fxStates & (1<<i))) {
         // send ON
         sendBuffer[count++] = 1;
@@ -198,6 +345,7 @@ static void _load_program(uint8_t program) {
   }
 
   _fbv_tx_many(sendBuffer, count);
+  _midi_send_dump(program);
   pod.currentProgram = program;
 }
 
@@ -210,7 +358,7 @@ static void _change_fx_state(uint8_t fxId, uint8_t state, uint8_t fbv_send) {
   }
   if (fbv_send) {
     sendBuffer[0] = 0xF0; sendBuffer[1] = 0x03; sendBuffer[2] = 0x04;
-    sendBuffer[3] = led_mapping[fxId]; sendBuffer[4] = state ? 1 : 0;
+    sendBuffer[3] = FBVMAP_FX_LEDS[fxId]; sendBuffer[4] = state ? 1 : 0;
     _fbv_queue_tx(sendBuffer, 5);
   }
 }
@@ -252,27 +400,96 @@ static void _change_control(uint8_t control, uint8_t value) {
       _change_fx_state(VIRTUAL_FX_EQ_IDX, 0, 1);
     }
     break;
+  case BOD_CTL_TEMPO_MSB:
+    pod.tempoMsb = value;
+    break;
+  case BOD_CTL_TEMPO_LSB:
+    pod.tempo = (pod.tempoMsb << 7) | value;
+    printf("VPOD: tempo set to %u.%u BPM\n", pod.tempo / 10, pod.tempo % 10);
+    // new reference
+    midiClock.pulses = 0;
+    break;
   default:
     break;
   }
 }
 
+// POD side of the FBV link, processed on next cycle
+static void _fbv_rx(FBVContext* ctx, const FBVMessageView* msg) {
+  VirtualPOD* vpod = (VirtualPOD*)ctx->cfg.user;
+  vpod->fbvRxMsg.msgType = msg->msgType;
+  vpod->fbvRxMsg.paramSize = msg->paramSize;
+  memcpy(vpod->fbvRxMsg.params, msg->params, msg->paramSize);
+  vpod->flags |= VIRTUAL_FLAG_PACKET_RX;
+}
+
+// footswitch reported natively over FBV
+static void _switch_event(uint8_t sw, uint8_t state) {
+  uint8_t i = 0;
+  uint8_t bank = pod.currentProgram ? (pod.currentProgram - 1)/4 : 0;
+  if (!state) {
+    return;
+  }
+
+  if (sw == FBV_SW_TAP) {
+    printf("VPOD: tap\n");
+    return;
+  }
+  if (sw == FBV_SW_BANK_UP) {
+    _load_program(4*(bank + 1) + 1);
+    return;
+  }
+  if (sw == FBV_SW_BANK_DN) {
+    if (bank) {
+      _load_program(4*(bank - 1) + 1);
+    }
+    return;
+  }
+  for (i = 0; i < FBVMAP_CHANNEL_COUNT; i++) {
+    if (FBVMAP_CHANNEL_LEDS[i] == sw) {
+      _load_program(4*bank + i + 1);
+      return;
+    }
+  }
+  for (i = 0; i < VIRTUAL_FX_COUNT; i++) {
+    if (FBVMAP_FX_LEDS[i] == sw) {
+      _change_fx_state(i, (pod.fxStates & (1<<i)) ? 0 : 1, 1);
+      return;
+    }
+  }
+}
+
 static void _fbv_packet_received() {
-  printf("VPOD: FBV packet received: 0xF0 ");
-  _dump_packet(pod.fbvRxBuffer, pod.fbvWrPtr);
+  printf("VPOD: FBV packet received: 0xF0 0x%hhx 0x%hhx%c",
+         pod.fbvRxMsg.paramSize + 1, pod.fbvRxMsg.msgType,
+         pod.fbvRxMsg.paramSize ? ' ' : '\n');
+  if (pod.fbvRxMsg.paramSize) {
+    _dump_packet(pod.fbvRxMsg.params, pod.fbvRxMsg.paramSize);
+  }
 
   if (!(pod.flags & VIRTUAL_FLAG_CONNECTED)) {
-    if (pod.fbvRxBuffer[BUFFER_CMD_OFFSET] == 0x90) {
+    if (pod.fbvRxMsg.msgType == FBV_PROBE) {
       // ping from FBV, send back a bunch of garbage and a pingback
       pod.flags |= (VIRTUAL_FLAG_CONNECTED | VIRTUAL_FLAG_LOAD_INITIAL);
       _fbv_queue_tx((uint8_t *)pod_ping, 4);
     }
   } else {
     // normal operation
-    switch (pod.fbvRxBuffer[BUFFER_CMD_OFFSET]) {
-    case 0x80:
+    switch (pod.fbvRxMsg.msgType) {
+    case FBV_ACK:
       _fbv_queue_tx((uint8_t *)pod_ping, 4);
       break;
+    case FBV_BTN_STAT:
+      if (pod.fbvRxMsg.paramSize >= 2) {
+        _switch_event(pod.fbvRxMsg.params[0], pod.fbvRxMsg.params[1]);
+      }
+      break;
+    case FBV_CTL_STAT:
+      if (pod.fbvRxMsg.paramSize >= 2) {
+        printf("VPOD: pedal %hhu at %hhu\n", pod.fbvRxMsg.params[0],
+               pod.fbvRxMsg.params[1]);
+      }
+      break;
     default:
       break;
     }
@@ -296,25 +513,21 @@ static void _midi_packet_received()  {
   }
 }
 
-void VIRTUAL_initialize(void) {
-  printf("INFO: Virtual HW initialized\n");
-  memset(&pod, 0, sizeof(VirtualPOD));
-  pod.flags = VIRTUAL_FLAG_STARTING;
-  pod.fbvRxState = VIRTUAL_RXSTATE_INITIAL;
+static void _virtual_started(tick_t now) {
+  (void)now;
+  pod.flags &= ~VIRTUAL_FLAG_STARTING;
+  printf("INFO: Virtual POD available\n");
 }
 
-void VIRTUAL_cycle(void) {
-  tick_t now = TICK_get();
+static void _virtual_cycle(tick_t now) {
+  unsigned int i = 0;
 
-  if (pod.flags & VIRTUAL_FLAG_STARTING) {
-    if (now > VIRTUAL_STARTUP_TIME) {
-      pod.flags &= ~VIRTUAL_FLAG_STARTING;
-      printf("INFO: Virtual POD available\n");
+  while (MIDI_MERGE_ENABLE && pod.seqNext < VIRTUAL_SEQ_SCRIPT_LEN &&
+         seq_script[pod.seqNext].time <= now) {
+    for (i = 0; i < seq_script[pod.seqNext].size; i++) {
+      SERIAL_midi_inject(seq_script[pod.seqNext].bytes[i]);
     }
-  }
-
-  if (now - pod.lastCycle < VIRTUAL_CYCLE_INTERVAL) {
-    return;
+    pod.seqNext++;
   }
 
   if (pod.flags & VIRTUAL_FLAG_LOAD_INITIAL) {
@@ -330,8 +543,22 @@ void VIRTUAL_cycle(void) {
     _fbv_packet_received();
     pod.flags &= ~VIRTUAL_FLAG_PACKET_RX;
   }
+}
+
+void VIRTUAL_initialize(void) {
+  FBVStateMachineConfig linkCfg;
+  printf("INFO: Virtual HW initialized\n");
+  memset(&pod, 0, sizeof(VirtualPOD));
+  pod.flags = VIRTUAL_FLAG_STARTING;
+
+  // the POD end of the link gets its own parser instance
+  memset(&linkCfg, 0, sizeof(FBVStateMachineConfig));
+  linkCfg.msgRxCtx = _fbv_rx;
+  linkCfg.user = &pod;
+  FBV_ctx_initialize(&pod.fbvLink, &linkCfg);
 
-  pod.lastCycle = now;
+  TIMER_start(&pod.startup, VIRTUAL_STARTUP_TIME, 0, _virtual_started);
+  TIMER_start(&pod.cycle, VIRTUAL_CYCLE_INTERVAL, VIRTUAL_CYCLE_INTERVAL, _virtual_cycle);
 }
 
 void VIRTUAL_fbv_rxbyte(uint8_t byte) {
@@ -340,35 +567,45 @@ void VIRTUAL_fbv_rxbyte(uint8_t byte) {
     return;
   }
 
-  switch(pod.fbvRxState) {
-  case VIRTUAL_RXSTATE_INITIAL:
-    if (byte != 0xF0) {
-      break;
-    }
-    pod.fbvRxState = VIRTUAL_RXSTATE_LEN;
-    break;
-  case VIRTUAL_RXSTATE_LEN:
-    pod.fbvPendingBytes = byte;
-    pod.fbvRxState = VIRTUAL_RXSTATE_CMD;
-    pod.fbvRxBuffer[0] = byte;
-    pod.fbvWrPtr = 1;
-    break;
-  case VIRTUAL_RXSTATE_CMD:
-    pod.fbvPendingBytes--;
-    pod.fbvRxBuffer[pod.fbvWrPtr++] = byte;
-    pod.fbvRxState = VIRTUAL_RXSTATE_PRM;
-    break;
-  case VIRTUAL_RXSTATE_PRM:
-    pod.fbvPendingBytes--;
-    pod.fbvRxBuffer[pod.fbvWrPtr++] = byte;
-    if (!pod.fbvPendingBytes) {
-      pod.fbvRxState = VIRTUAL_RXSTATE_INITIAL;
-      pod.flags |= VIRTUAL_FLAG_PACKET_RX;
-    }
-    break;
-  default:
-    pod.fbvRxState = VIRTUAL_RXSTATE_INITIAL;
-    break;
+  FBV_ctx_recv_byte(&pod.fbvLink, byte);
+}
+
+// MIDI clock pulse: jitter is the worst deviation of a pulse interval
+// from the ideal one, drift how far the pulse train is off the ideal clock
+static void _midi_clock_pulse(void) {
+  uint64_t now = TICK_get_us();
+  uint32_t interval = 0;
+  uint32_t reference = 0;
+  uint32_t jitter = 0;
+  int64_t drift = 0;
+
+  if (!pod.tempo) {
+    return;
+  }
+  if (!midiClock.pulses) {
+    midiClock.start = now;
+    midiClock.last = now;
+    midiClock.maxJitter = 0;
+    midiClock.pulses = 1;
+    return;
+  }
+
+  // 24 pulses per beat, tempo in tenths of BPM
+  reference = 25000000UL / pod.tempo;
+  interval = (uint32_t)(now - midiClock.last);
+  jitter = interval > reference ? interval - reference : reference - interval;
+  if (jitter > midiClock.maxJitter) {
+    midiClock.maxJitter = jitter;
+  }
+  drift = (int64_t)(now - midiClock.start) -
+    (int64_t)midiClock.pulses * 25000000LL / pod.tempo;
+  midiClock.last = now;
+  midiClock.pulses++;
+
+  if (!((midiClock.pulses - 1) % 24)) {
+    printf("VPOD: MIDI clock beat %u: max jitter %u us, drift %lld us\n",
+           (midiClock.pulses - 1) / 24, midiClock.maxJitter, (long long)drift);
+    midiClock.maxJitter = 0;
   }
 }
 
@@ -378,13 +615,51 @@ void VIRTUAL_midi_rxbyte(uint8_t byte) {
     return;
   }
 
+  if (byte >= 0xF8) {
+    // realtime, doesn't touch running status
+    switch (byte) {
+    case 0xF8:
+      _midi_clock_pulse();
+      break;
+    case 0xFA:
+      printf("VPOD: MIDI clock start\n");
+      midiClock.pulses = 0;
+      break;
+    case 0xFC:
+      printf("VPOD: MIDI clock stop\n");
+      break;
+    default:
+      break;
+    }
+    return;
+  }
+  if (byte & 0x80) {
+    if (pod.midiInSysex) {
+      printf("VPOD: SysEx of %u bytes%s\n", pod.midiSysexSize,
+             byte == 0xF7 ? "" : ", cut short");
+    }
+    pod.midiInSysex = byte == 0xF0;
+    pod.midiSysexSize = 0;
+    // any status byte starts a new message; only CC/PC are kept as
+    // running status
+    pod.midiRxBuffer[0] = (MIDI_IS_CC(byte) || MIDI_IS_PC(byte)) ? byte : 0;
+    pod.midiRxState = pod.midiRxBuffer[0] ? VIRTUAL_MIDI_RX_CCPC : VIRTUAL_MIDI_RX_CMD;
+    return;
+  }
+  if (pod.midiInSysex) {
+    pod.midiSysexSize++;
+    return;
+  }
+
   switch(pod.midiRxState) {
   case VIRTUAL_MIDI_RX_CMD:
-    if (MIDI_IS_CC(byte) || MIDI_IS_PC(byte)) {
-      pod.midiRxState = VIRTUAL_MIDI_RX_CCPC;
-      pod.midiRxBuffer[0] = byte;
+    if (!pod.midiRxBuffer[0]) {
+      // data without a status, drop
+      break;
     }
-    break;
+    // running status, this is the first data byte
+    pod.midiRxState = VIRTUAL_MIDI_RX_CCPC;
+    // fall through
   case VIRTUAL_MIDI_RX_CCPC:
     pod.midiRxBuffer[1] = byte;
     if (MIDI_IS_CC(pod.midiRxBuffer[0])) {
@@ -404,3 +679,95 @@ void VIRTUAL_midi_rxbyte(uint8_t byte) {
     break;
   }
 }
+
+uint32_t VIRTUAL_btn_states(void) {
+  tick_t now = TICK_get();
+  uint32_t states = 0;
+  tick_t since = 0;
+  unsigned int i = 0;
+  for (i = 0; i < VIRTUAL_BTN_SCRIPT_LEN; i++) {
+    if (btn_script[i].time > now) {
+      break;
+    }
+    states = btn_script[i].states;
+    since = btn_script[i].time;
+  }
+  if (states & ~leds.btnStates & VIRTUAL_LED_BTNS) {
+    leds.pressAt = since * 1000;
+    leds.pressed = states & ~leds.btnStates;
+  } else if (!(states & VIRTUAL_LED_BTNS)) {
+    // released without lighting anything
+    leds.pressAt = 0;
+  }
+  leds.btnStates = states;
+  return states;
+}
+
+void VIRTUAL_leds(uint32_t states) {
+  uint32_t latency = 0;
+  uint32_t changed = states ^ leds.states;
+
+  leds.pinWrites += __builtin_popcount(states ^ leds.states);
+  leds.states = states;
+  if (!(leds.pressed & VIRTUAL_BTN(BTN_DLY))) {
+    changed &= ~VIRTUAL_LED_TAP;
+  }
+  if (!changed || !leds.pressAt) {
+    return;
+  }
+  latency = (uint32_t)(TICK_get_us() - leds.pressAt);
+  leds.pressAt = 0;
+  leds.count++;
+  leds.total += latency;
+  if (latency > leds.max) {
+    leds.max = latency;
+  }
+  printf("VLED: press to light %u us, max %u us, mean %u us\n",
+         latency, leds.max, (uint32_t)(leds.total / leds.count));
+}
+
+void VIRTUAL_lcd(LCDContents* contents) {
+  uint32_t bytes = 0;
+  uint8_t placed = 0;
+  unsigned int i = 0, j = 0;
+
+  if (!lcd.draws) {
+    // cleared to blanks
+    memset(lcd.shown, 0x20, sizeof(LCDContents));
+  }
+  for (i = 0; i < LCD_ROWS; i++) {
+    placed = 0;
+    for (j = 0; j < LCD_COLS; j++) {
+      if ((*contents)[i][j] == lcd.shown[i][j]) {
+        placed = 0;
+        continue;
+      }
+      // cursor address, then the character
+      bytes += placed ? 1 : 2;
+      placed = 1;
+      lcd.shown[i][j] = (*contents)[i][j];
+    }
+  }
+  lcd.draws++;
+  printf("VLCD: draw %u '%.16s|%.16s', %u bytes, %u LED pin writes since the last one\n",
+         lcd.draws, lcd.shown[0], lcd.shown[1], bytes, leds.pinWrites);
+  leds.pinWrites = 0;
+}
+
+uint16_t VIRTUAL_exp_values(void) {
+  tick_t now = TICK_get();
+  uint16_t values = 0;
+  uint8_t value = 0;
+  unsigned int i = 0;
+  for (i = 0; i < 2; i++) {
+    if (now < exp_script[i].start) {
+      value = 0;
+    } else if (now >= exp_script[i].start + exp_script[i].duration) {
+      value = 127;
+    } else {
+      value = (127*(now - exp_script[i].start))/exp_script[i].duration;
+    }
+    values |= (uint16_t)value << (8*i);
+  }
+  return values;
+}
@@ -2,12 +2,16 @@
 #define _VIRTUAL_H_INCLUDED_
 
 #include "config.h"
+#include "lcd.h"
 
 // Virtual Hardware
 
 void VIRTUAL_initialize(void);
-void VIRTUAL_cycle(void);
 void VIRTUAL_fbv_rxbyte(uint8_t byte);
 void VIRTUAL_midi_rxbyte(uint8_t byte);
+uint32_t VIRTUAL_btn_states(void);
+uint16_t VIRTUAL_exp_values(void);
+void VIRTUAL_leds(uint32_t states);
+void VIRTUAL_lcd(LCDContents* contents);
 
 #endif
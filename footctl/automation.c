@@ -0,0 +1,215 @@
+#include "automation.h"
+#include "clock.h"
+#include "tempo.h"
+#include "store.h"
+#include <string.h>
+#ifdef VIRTUAL_HW
+#include <stdio.h>
+#include "tick.h"
+#endif
+
+// an event is the time since the previous one in 1/AUTOMATION_PPQN beats
+// as a varint, 7 bits a byte with the low ones first, then
+// op << 4 | FX index. A program change is followed by the program
+#define AUTOMATION_OP_SHIFT 4
+#define AUTOMATION_ARG_MASK 0x0F
+#define AUTOMATION_VARINT_MORE 0x80
+// 5 varint bytes, the op and the program
+#define AUTOMATION_EVENT_MAX 7
+
+// a 1/480 beat lasts 1250 / bpm10 ms
+#define AUTOMATION_UNIT_NUM 1250UL
+#define AUTOMATION_MAGIC 0x4155
+// saved once playback or the clock may have started, whenever that's done
+#define AUTOMATION_SAVE_DELAY 1000
+
+typedef struct automation_s {
+  AutomationAction action;
+  AutomationState state;
+  uint8_t data[AUTOMATION_SIZE];
+  uint16_t size;
+  // time of the last recorded event
+  tick_t last;
+  // playback read position and the event waiting for its alarm
+  uint16_t pos;
+  uint8_t nextOp;
+  uint8_t nextValue;
+#ifdef VIRTUAL_HW
+  uint32_t played;
+  uint32_t maxError;
+  uint64_t totalError;
+#endif
+} Automation;
+
+static Automation autom;
+
+static inline uint16_t _tempo(void) {
+  uint16_t bpm10 = TEMPO_get_bpm10();
+  return bpm10 ? bpm10 : AUTOMATION_DEFAULT_BPM10;
+}
+
+void AUTOMATION_initialize(AutomationAction action) {
+  memset(&autom, 0, sizeof(Automation));
+  autom.action = action;
+#ifdef AUTOMATION_FLASH
+  STORE_configure(STORE_AUTOMATION, AUTOMATION_FLASH_ADDR, STORE_PAGE_SIZE, AUTOMATION_MAGIC);
+  autom.size = STORE_load(STORE_AUTOMATION, autom.data, AUTOMATION_SIZE);
+#endif
+}
+
+// replaces what was recorded before
+void AUTOMATION_record(tick_t now) {
+  AUTOMATION_stop();
+#ifdef AUTOMATION_FLASH
+  // the data is about to change under it
+  STORE_cancel(STORE_AUTOMATION);
+#endif
+  autom.state = AUTOMATION_RECORDING;
+  autom.size = 0;
+  autom.last = now;
+#ifdef VIRTUAL_HW
+  printf("VAUTO: recording\n");
+#endif
+}
+
+void AUTOMATION_add(uint8_t op, uint8_t value, tick_t now) {
+  uint32_t units = 0;
+
+  if (autom.state != AUTOMATION_RECORDING) {
+    return;
+  }
+  if (autom.size + AUTOMATION_EVENT_MAX > AUTOMATION_SIZE) {
+    // full, keep what fits
+    AUTOMATION_stop();
+    return;
+  }
+
+  if (now < autom.last) {
+    // stamped when it started, something else got in since
+    now = autom.last;
+  }
+  // at the tempo of the moment, rounded to the nearest unit
+  units = ((uint32_t)(now - autom.last) * _tempo() + AUTOMATION_UNIT_NUM / 2) /
+    AUTOMATION_UNIT_NUM;
+  autom.last = now;
+  while (units >= AUTOMATION_VARINT_MORE) {
+    autom.data[autom.size++] = (uint8_t)(units | AUTOMATION_VARINT_MORE);
+    units >>= 7;
+  }
+  autom.data[autom.size++] = (uint8_t)units;
+  if (op == AUTOMATION_PROGRAM) {
+    autom.data[autom.size++] = op << AUTOMATION_OP_SHIFT;
+    autom.data[autom.size++] = value;
+  } else {
+    autom.data[autom.size++] = (op << AUTOMATION_OP_SHIFT) | (value & AUTOMATION_ARG_MASK);
+  }
+}
+
+// decode the event at the read position into nextOp/nextValue; returns
+// its delay in us, valid is cleared past the end
+static uint32_t _read_event(uint8_t* valid) {
+  uint32_t units = 0;
+  uint8_t shift = 0;
+  uint8_t byte = 0;
+
+  *valid = 0;
+  do {
+    if (autom.pos >= autom.size) {
+      return 0;
+    }
+    byte = autom.data[autom.pos++];
+    units |= (uint32_t)(byte & ~AUTOMATION_VARINT_MORE) << shift;
+    shift += 7;
+  } while (byte & AUTOMATION_VARINT_MORE);
+  if (autom.pos >= autom.size) {
+    return 0;
+  }
+  byte = autom.data[autom.pos++];
+  autom.nextOp = byte >> AUTOMATION_OP_SHIFT;
+  autom.nextValue = byte & AUTOMATION_ARG_MASK;
+  if (autom.nextOp == AUTOMATION_PROGRAM) {
+    if (autom.pos >= autom.size) {
+      return 0;
+    }
+    autom.nextValue = autom.data[autom.pos++];
+  }
+  *valid = 1;
+  // at the tempo of the moment, so taps played back take effect
+  return (uint32_t)((uint64_t)units * AUTOMATION_UNIT_NUM * 1000 / _tempo());
+}
+
+// events are timed by the clock timer's alarm, each one from the
+// deadline of the previous one
+void AUTOMATION_play(void) {
+  uint32_t delay = 0;
+  uint8_t valid = 0;
+
+  AUTOMATION_stop();
+  autom.pos = 0;
+  delay = _read_event(&valid);
+  if (!valid) {
+    return;
+  }
+  autom.state = AUTOMATION_PLAYING;
+  CLOCK_set_alarm(delay, 0);
+#ifdef VIRTUAL_HW
+  autom.played = 0;
+  autom.maxError = 0;
+  autom.totalError = 0;
+  printf("VAUTO: playing %u bytes\n", autom.size);
+#endif
+}
+
+void AUTOMATION_stop(void) {
+  if (autom.state == AUTOMATION_RECORDING) {
+#ifdef VIRTUAL_HW
+    printf("VAUTO: recorded %u bytes\n", autom.size);
+#endif
+#ifdef AUTOMATION_FLASH
+    STORE_save(STORE_AUTOMATION, autom.data, autom.size, AUTOMATION_SAVE_DELAY);
+#endif
+  } else if (autom.state == AUTOMATION_PLAYING) {
+    CLOCK_cancel_alarm();
+  }
+  autom.state = AUTOMATION_IDLE;
+}
+
+AutomationState AUTOMATION_get_state(void) {
+  return autom.state;
+}
+
+// call on every pass of the main loop, a due event is late by as much
+// as the loop takes to come back here
+void AUTOMATION_cycle(void) {
+  uint32_t delay = 0;
+  uint8_t valid = 0;
+#ifdef VIRTUAL_HW
+  uint32_t error = 0;
+#endif
+
+  if (autom.state != AUTOMATION_PLAYING || !CLOCK_alarm_due()) {
+    return;
+  }
+#ifdef VIRTUAL_HW
+  error = (uint32_t)(TICK_get_us() - CLOCK_alarm_time());
+  autom.played++;
+  autom.totalError += error;
+  if (error > autom.maxError) {
+    autom.maxError = error;
+  }
+#endif
+  if (autom.action) {
+    (autom.action)(autom.nextOp, autom.nextValue);
+  }
+
+  delay = _read_event(&valid);
+  if (!valid) {
+#ifdef VIRTUAL_HW
+    printf("VAUTO: played %u events, timing error max %u us, mean %u us\n",
+           autom.played, autom.maxError, (uint32_t)(autom.totalError / autom.played));
+#endif
+    autom.state = AUTOMATION_IDLE;
+    return;
+  }
+  CLOCK_set_alarm(delay, 1);
+}
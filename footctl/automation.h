@@ -0,0 +1,43 @@
+#ifndef _AUTOMATION_H_INCLUDED_
+#define _AUTOMATION_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// recorded events, a few bytes each
+#define AUTOMATION_SIZE 256
+// event times are kept in beats, so playback follows the tapped tempo
+#define AUTOMATION_PPQN 480
+// tempo used until one is tapped
+#define AUTOMATION_DEFAULT_BPM10 1200
+
+// actions are stored with their outcome, not as the switch that caused
+// them, so playback doesn't depend on the state it starts from
+typedef enum automation_op_e
+  {
+   // value is the program
+   AUTOMATION_PROGRAM = 0,
+   // value is the FX index
+   AUTOMATION_FX_ON,
+   AUTOMATION_FX_OFF,
+   AUTOMATION_TAP
+  } AutomationOp;
+
+typedef enum automation_state_e
+  {
+   AUTOMATION_IDLE = 0,
+   AUTOMATION_RECORDING,
+   AUTOMATION_PLAYING
+  } AutomationState;
+
+typedef void (*AutomationAction)(uint8_t op, uint8_t value);
+
+void AUTOMATION_initialize(AutomationAction action);
+void AUTOMATION_record(tick_t now);
+void AUTOMATION_add(uint8_t op, uint8_t value, tick_t now);
+void AUTOMATION_play(void);
+void AUTOMATION_stop(void);
+AutomationState AUTOMATION_get_state(void);
+void AUTOMATION_cycle(void);
+
+#endif
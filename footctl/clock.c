@@ -0,0 +1,294 @@
+#include "clock.h"
+#include "serial.h"
+#include "tempo.h"
+#include "sched.h"
+#ifdef VIRTUAL_HW
+#include "tick.h"
+#else
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#endif
+
+// the pulse train is timed in CLOCK_TIMER_FREQ ticks; the emulation
+// counts microseconds, the hardware runs TIM3 at 2us
+#ifdef VIRTUAL_HW
+#define CLOCK_TIMER_FREQ 1000000UL
+#else
+#define CLOCK_TIMER_FREQ 500000UL
+#ifdef STM32_MOCK
+// APB1 is at 36 MHz, its timers get twice that
+#define CLOCK_TIMER_INPUT 72000000UL
+#else
+#define CLOCK_TIMER_INPUT 48000000UL
+#endif
+// longest compare step of the 16 bit timer
+#define CLOCK_MAX_STEP 0x8000
+#endif
+
+// ticks per pulse is CLOCK_TIMER_FREQ * 60 / (24 * bpm), with the tempo in
+// tenths of BPM that's CLOCK_PERIOD_NUM / bpm10
+#define CLOCK_PERIOD_NUM (CLOCK_TIMER_FREQ * 600UL / CLOCK_PPQN)
+#define CLOCK_US_PER_TICK (1000000UL / CLOCK_TIMER_FREQ)
+
+#define CLOCK_FLAG_RUNNING 0x01
+
+// requests are stored by the main loop and consumed by the timer
+#define CLOCK_REQ_NONE 0
+#define CLOCK_REQ_START 1
+#define CLOCK_REQ_STOP 2
+
+typedef struct clock_s {
+  volatile uint8_t flags;
+  volatile uint8_t request;
+  volatile uint16_t bpm10;
+  // Bresenham accumulator for the fraction of a tick each period loses
+  uint16_t error;
+  // ticks left until the next pulse
+  uint32_t wait;
+  // one shot alarm on the second compare channel, set by the timer
+  volatile uint8_t alarmDue;
+#ifdef VIRTUAL_HW
+  uint64_t lastEvent;
+  uint8_t alarmArmed;
+  uint64_t alarmAt;
+#else
+  uint32_t alarmWait;
+#endif
+} Clock;
+
+static Clock clk;
+
+// length of the next pulse period in timer ticks
+static uint32_t _next_period(void) {
+  uint16_t bpm10 = clk.bpm10;
+  uint32_t period = CLOCK_PERIOD_NUM / bpm10;
+
+  if (clk.error >= bpm10) {
+    // tempo went down since the last pulse
+    clk.error = 0;
+  }
+  clk.error += CLOCK_PERIOD_NUM % bpm10;
+  if (clk.error >= bpm10) {
+    clk.error -= bpm10;
+    period++;
+  }
+  return period;
+}
+
+// runs on every timer event; returns the ticks until the next one
+static uint32_t _clock_event(void) {
+  uint32_t step = 0;
+
+  if (clk.request == CLOCK_REQ_STOP) {
+    clk.request = CLOCK_REQ_NONE;
+    if (clk.flags & CLOCK_FLAG_RUNNING) {
+      SERIAL_midi_realtime(CLOCK_MIDI_STOP);
+    }
+    clk.flags &= ~CLOCK_FLAG_RUNNING;
+    return 0;
+  }
+  if (clk.request == CLOCK_REQ_START) {
+    // the pulse following start is the downbeat
+    clk.request = CLOCK_REQ_NONE;
+    SERIAL_midi_realtime(CLOCK_MIDI_START);
+    clk.flags |= CLOCK_FLAG_RUNNING;
+    clk.error = 0;
+    clk.wait = 0;
+  }
+  if (!(clk.flags & CLOCK_FLAG_RUNNING)) {
+    // a stray compare match, nothing to send
+    return 0;
+  }
+  if (!clk.wait) {
+    SERIAL_midi_realtime(CLOCK_MIDI_CLOCK);
+    clk.wait = _next_period();
+  }
+  step = clk.wait;
+#ifndef VIRTUAL_HW
+  if (step > CLOCK_MAX_STEP) {
+    step = CLOCK_MAX_STEP;
+  }
+#endif
+  clk.wait -= step;
+  return step;
+}
+
+void CLOCK_initialize(void) {
+  clk.flags = 0;
+  clk.request = CLOCK_REQ_NONE;
+  clk.bpm10 = 1200;
+  clk.error = 0;
+  clk.wait = 0;
+  clk.alarmDue = 0;
+#ifdef VIRTUAL_HW
+  clk.alarmArmed = 0;
+#else
+  clk.alarmWait = 0;
+  // free running 16 bit counter, pulses are scheduled on compare channel 1
+  rcc_periph_clock_enable(RCC_TIM3);
+  timer_set_mode(TIM3, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+  timer_set_prescaler(TIM3, CLOCK_TIMER_INPUT / CLOCK_TIMER_FREQ - 1);
+  timer_set_period(TIM3, 0xFFFF);
+  timer_disable_oc_preload(TIM3, TIM_OC1);
+  timer_enable_counter(TIM3);
+  nvic_enable_irq(NVIC_TIM3_IRQ);
+#endif
+}
+
+void CLOCK_set_tempo(uint16_t bpm10) {
+  if (bpm10 < TEMPO_MIN_BPM10 || bpm10 > TEMPO_MAX_BPM10) {
+    return;
+  }
+  // picked up at the next pulse
+  clk.bpm10 = bpm10;
+}
+
+void CLOCK_start(void) {
+  clk.request = CLOCK_REQ_START;
+#ifdef VIRTUAL_HW
+  clk.lastEvent = TICK_get_us();
+#else
+  // first event right away
+  timer_set_oc_value(TIM3, TIM_OC1, timer_get_counter(TIM3) + 2);
+  timer_clear_flag(TIM3, TIM_SR_CC1IF);
+  timer_enable_irq(TIM3, TIM_DIER_CC1IE);
+#endif
+}
+
+void CLOCK_stop(void) {
+  clk.request = CLOCK_REQ_STOP;
+}
+
+uint8_t CLOCK_is_running(void) {
+  return ((clk.flags & CLOCK_FLAG_RUNNING) || clk.request == CLOCK_REQ_START) ? 1 : 0;
+}
+
+#ifndef VIRTUAL_HW
+// the alarm is reached in steps the 16 bit timer can take
+static uint32_t _alarm_step(void) {
+  uint32_t step = clk.alarmWait;
+
+  if (step > CLOCK_MAX_STEP) {
+    step = CLOCK_MAX_STEP;
+  }
+  clk.alarmWait -= step;
+  return step;
+}
+#endif
+
+// CLOCK_alarm_due turns true us microseconds from now, or from the
+// previous alarm's deadline when chained, so a series of alarms doesn't
+// drift with the main loop's latency
+void CLOCK_set_alarm(uint32_t us, uint8_t chained) {
+#ifdef VIRTUAL_HW
+  clk.alarmAt = (chained ? clk.alarmAt : TICK_get_us()) + us;
+  clk.alarmDue = 0;
+  clk.alarmArmed = 1;
+#else
+  uint16_t base = chained ? TIM_CCR2(TIM3) : timer_get_counter(TIM3);
+  uint32_t step = 0;
+
+  timer_disable_irq(TIM3, TIM_DIER_CC2IE);
+  clk.alarmDue = 0;
+  clk.alarmWait = us / CLOCK_US_PER_TICK;
+  step = _alarm_step();
+  if (!step) {
+    clk.alarmDue = 1;
+    return;
+  }
+  timer_set_oc_value(TIM3, TIM_OC2, (uint16_t)(base + step));
+  timer_clear_flag(TIM3, TIM_SR_CC2IF);
+  if ((uint16_t)(timer_get_counter(TIM3) - base) >= step) {
+    // already past it, let the interrupt carry on from the deadline
+    timer_generate_event(TIM3, TIM_EGR_CC2G);
+  }
+  timer_enable_irq(TIM3, TIM_DIER_CC2IE);
+#endif
+}
+
+void CLOCK_cancel_alarm(void) {
+#ifdef VIRTUAL_HW
+  clk.alarmArmed = 0;
+#else
+  timer_disable_irq(TIM3, TIM_DIER_CC2IE);
+  clk.alarmWait = 0;
+#endif
+  clk.alarmDue = 0;
+}
+
+// true once per alarm
+uint8_t CLOCK_alarm_due(void) {
+  if (!clk.alarmDue) {
+    return 0;
+  }
+  clk.alarmDue = 0;
+  return 1;
+}
+
+#ifdef VIRTUAL_HW
+uint64_t CLOCK_alarm_time(void) {
+  return clk.alarmAt;
+}
+
+// when the emulated timer has something to do next, 0 if nothing
+uint64_t CLOCK_next_event(void) {
+  uint64_t next = 0;
+
+  if ((clk.flags & CLOCK_FLAG_RUNNING) || clk.request) {
+    next = clk.lastEvent;
+  }
+  if (clk.alarmArmed && (!next || clk.alarmAt < next)) {
+    next = clk.alarmAt;
+  }
+  return next;
+}
+
+// emulate the timer: fire every event that came due since the last call
+void CLOCK_cycle(void) {
+  uint64_t now = TICK_get_us();
+  uint32_t step = 0;
+
+  if (clk.alarmArmed && now >= clk.alarmAt) {
+    clk.alarmArmed = 0;
+    clk.alarmDue = 1;
+    SCHED_post(SCHED_EVENT_TIMER);
+  }
+
+  while (((clk.flags & CLOCK_FLAG_RUNNING) || clk.request) && now >= clk.lastEvent) {
+    step = _clock_event();
+    clk.lastEvent += step;
+    if (!step) {
+      break;
+    }
+  }
+}
+#else
+// the compare flags are set on every match, enabled or not; only the
+// channels in use are looked at
+void tim3_isr(void) {
+  uint32_t step = 0;
+
+  if ((TIM_DIER(TIM3) & TIM_DIER_CC1IE) && timer_get_flag(TIM3, TIM_SR_CC1IF)) {
+    timer_clear_flag(TIM3, TIM_SR_CC1IF);
+    step = _clock_event();
+    if (step) {
+      timer_set_oc_value(TIM3, TIM_OC1, (uint16_t)(TIM_CCR1(TIM3) + step));
+    } else {
+      // stopped
+      timer_disable_irq(TIM3, TIM_DIER_CC1IE);
+    }
+  }
+  if ((TIM_DIER(TIM3) & TIM_DIER_CC2IE) && timer_get_flag(TIM3, TIM_SR_CC2IF)) {
+    timer_clear_flag(TIM3, TIM_SR_CC2IF);
+    step = _alarm_step();
+    if (step) {
+      timer_set_oc_value(TIM3, TIM_OC2, (uint16_t)(TIM_CCR2(TIM3) + step));
+    } else {
+      timer_disable_irq(TIM3, TIM_DIER_CC2IE);
+      clk.alarmDue = 1;
+      SCHED_post(SCHED_EVENT_TIMER);
+    }
+  }
+}
+#endif
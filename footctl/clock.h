@@ -0,0 +1,29 @@
+#ifndef _CLOCK_H_INCLUDED_
+#define _CLOCK_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// MIDI realtime messages
+#define CLOCK_MIDI_CLOCK 0xF8
+#define CLOCK_MIDI_START 0xFA
+#define CLOCK_MIDI_STOP 0xFC
+
+// pulses per quarter note
+#define CLOCK_PPQN 24
+
+void CLOCK_initialize(void);
+void CLOCK_set_tempo(uint16_t bpm10);
+void CLOCK_start(void);
+void CLOCK_stop(void);
+uint8_t CLOCK_is_running(void);
+void CLOCK_set_alarm(uint32_t us, uint8_t chained);
+void CLOCK_cancel_alarm(void);
+uint8_t CLOCK_alarm_due(void);
+#ifdef VIRTUAL_HW
+void CLOCK_cycle(void);
+uint64_t CLOCK_alarm_time(void);
+uint64_t CLOCK_next_event(void);
+#endif
+
+#endif
@@ -8,12 +8,30 @@
 #endif
 
 #define POD_MIDI_CHANNEL 1
+// resend the MIDI status byte at least every N messages (0: no running status)
+#define POD_STATUS_REFRESH 16
+// bytes per second pedal CCs may use out of the 3125 the MIDI line carries
+#define POD_CC_BUDGET 2000
+// banks of 4 channels on the POD
+#define POD_BANK_COUNT 16
 #define IO_BTN_COUNT 12
 #define IO_LED_COUNT 10
 
 // button poll configuration
 #define BTN_POLL_INTERVAL 20
 #define BTN_DEBOUNCE_COUNT 2
+// ms a switch is held down for its second function
+#define BTN_HOLD_TIME 500
+
+// in MIDI mode UP/DN browse banks without loading them; the program changes
+// on a channel switch, or after BROWSE_TIMEOUT ms to the same channel of
+// the bank shown (0 waits for the switch)
+#define BROWSE_TIMEOUT 1500
+// held UP/DN step again after BROWSE_REPEAT_DELAY, then every
+// BROWSE_REPEAT_RATE ms, speeding up to BROWSE_REPEAT_FASTEST
+#define BROWSE_REPEAT_DELAY 400
+#define BROWSE_REPEAT_RATE 250
+#define BROWSE_REPEAT_FASTEST 60
 
 // expression pedal poll configuration
 #define EXP_POLL_INTERVAL 10
@@ -21,6 +39,59 @@
 #define EXP1_CC BOD_CTL_VOL
 #define EXP2_CC BOD_CTL_WAHPOS
 
+// where footswitch and pedal events go: MIDI CC/PC on USART2, native
+// FBV_BTN_STAT/FBV_CTL_STAT on the FBV link, or both
+#define OUTPUT_MIDI 0x1
+#define OUTPUT_FBV 0x2
+#define OUTPUT_MODE (OUTPUT_MIDI)
+// in MIDI mode, light LEDs and the display on the press itself rather
+// than when the POD echoes the change
+#define OPTIMISTIC_FEEDBACK 1
+
+// send MIDI clock at the tapped tempo
+#define MIDI_CLOCK_ENABLE 1
+
+// tempo synced modulation (lfo.h): each LFO sweeps a control while an
+// effect is on, its period in 1/24 beats. LFO_GATE_OFF leaves it unused.
+// An LFO on EXP1_CC or EXP2_CC never runs, the pedal owns that control
+#define LFO_GATE_OFF 0xFF
+// auto-pan at two beats a sweep
+#define LFO1_CC BOD_CTL_PAN
+#define LFO1_SHAPE LFO_TRIANGLE
+#define LFO1_PERIOD 48
+#define LFO1_MIN 0x10
+#define LFO1_MAX 0x70
+#define LFO1_GATE LFO_GATE_OFF
+// delay mix swelling in over a bar
+#define LFO2_CC BOD_CTL_DLY_MIX
+#define LFO2_SHAPE LFO_SWELL
+#define LFO2_PERIOD 96
+#define LFO2_MIN 0x00
+#define LFO2_MAX 0x7F
+#define LFO2_GATE LFO_GATE_OFF
+
+// MIDI in comes from another device (a sequencer) and is merged into what
+// we send to the POD, instead of coming back from the POD's MIDI out
+#define MIDI_MERGE_ENABLE 0
+
+// preset names and FX states remembered per program (16 banks of 4)
+#define PRESETS_COUNT 64
+// to keep a copy of them in the last 2 KB of flash, and recorded automation
+// in the page below (store.h); footctl/flash_store.ld keeps the firmware
+// out of those 3 KB
+//#define PRESETS_FLASH
+#define PRESETS_FLASH_ADDR 0x0800F800
+#define PRESETS_FLASH_SIZE 2048
+#define STORE_PAGE_SIZE 1024
+//#define AUTOMATION_FLASH
+#define AUTOMATION_FLASH_ADDR 0x0800F400
+
+// pressed together and held, these switches step footswitch automation
+// from idle to recording, to playing, and back to idle. Their presses go
+// out at once, only bank browsing is undone when the chord comes
+#define AUTOMATION_CHORD_A BTN_UP
+#define AUTOMATION_CHORD_B BTN_DN
+
 typedef uint64_t tick_t;
 
 #define CONFIG_LED_COUNT 8
@@ -47,6 +118,7 @@ typedef uint64_t tick_t;
 //MIDI
 #define GPIODEF_MIDI_TX_PORT GPIOA
 #define GPIODEF_MIDI_TX_PIN GPIO2
+// no MIDI in: USART2 RX is PA3, which is a button here
 //FBV
 #define GPIODEF_FBV_TX_PORT GPIOB
 #define GPIODEF_FBV_TX_PIN GPIO6
@@ -109,6 +181,10 @@ typedef uint64_t tick_t;
 //MIDI
 #define GPIODEF_MIDI_TX_PORT GPIOA
 #define GPIODEF_MIDI_TX_PIN GPIO2
+// no MIDI in on this board: PA15 (U1 pad 38) is unconnected and PA3 is a
+// button. define these for a board with a MIDI in circuit on PA15
+//#define GPIODEF_MIDI_RX_PORT GPIOA
+//#define GPIODEF_MIDI_RX_PIN GPIO15
 //FBV
 #define GPIODEF_FBV_TX_PORT GPIOB
 #define GPIODEF_FBV_TX_PIN GPIO6
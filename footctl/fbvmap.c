@@ -0,0 +1,53 @@
+#include "fbvmap.h"
+#include "io.h"
+
+const uint8_t FBVMAP_LEDS[FBVMAP_LED_COUNT] =
+  {
+   [FBV_LED_MOD] = FBVMAP_FX | POD_FX_MOD,
+   [FBV_LED_SB1] = FBVMAP_FX | POD_FX_STOMP,
+   [FBV_LED_SB2] = FBVMAP_FX | POD_FX_EQ,
+   [FBV_LED_SB3] = FBVMAP_FX | POD_FX_GATE,
+   [FBV_LED_DLY] = FBVMAP_FX | POD_FX_DLY,
+   [FBV_LED_AMP] = FBVMAP_FX | POD_FX_AMP,
+   [FBV_LED_WAH] = FBVMAP_FX | POD_FX_WAH,
+   [FBV_LED_CHA] = FBVMAP_CHANNEL | 0,
+   [FBV_LED_CHB] = FBVMAP_CHANNEL | 1,
+   [FBV_LED_CHC] = FBVMAP_CHANNEL | 2,
+   [FBV_LED_CHD] = FBVMAP_CHANNEL | 3,
+   [FBV_LED_TAP] = FBVMAP_TAP
+  };
+
+const FBVLED FBVMAP_FX_LEDS[POD_FX_COUNT] =
+  {
+   FBV_LED_SB2,
+   FBV_LED_SB1,
+   FBV_LED_MOD,
+   FBV_LED_DLY,
+   FBV_LED_SB3,
+   FBV_LED_AMP,
+   FBV_LED_WAH
+  };
+
+const FBVLED FBVMAP_CHANNEL_LEDS[FBVMAP_CHANNEL_COUNT] =
+  {
+   FBV_LED_CHA,
+   FBV_LED_CHB,
+   FBV_LED_CHC,
+   FBV_LED_CHD
+  };
+
+const FBVSwitch FBVMAP_BTN_SWITCHES[IO_BTN_COUNT] =
+  {
+   [BTN_CHA] = FBV_SW_CHA,
+   [BTN_CHB] = FBV_SW_CHB,
+   [BTN_CHC] = FBV_SW_CHC,
+   [BTN_CHD] = FBV_SW_CHD,
+   [BTN_EQ] = FBV_SW_SB2,
+   [BTN_STOMP] = FBV_SW_SB1,
+   [BTN_MOD] = FBV_SW_MOD,
+   [BTN_DLY] = FBV_SW_DLY,
+   [BTN_UP] = FBV_SW_BANK_UP,
+   [BTN_DN] = FBV_SW_BANK_DN,
+   [BTN_WAH] = FBV_SW_WAH,
+   [BTN_TAP] = FBV_SW_TAP
+  };
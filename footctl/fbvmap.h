@@ -0,0 +1,37 @@
+#ifndef _FBVMAP_H_INCLUDED_
+#define _FBVMAP_H_INCLUDED_
+
+#include <stdint.h>
+#include "fbv.h"
+#include "config.h"
+
+// togglable FX bits for internal state
+#define POD_FX_EQ 0x0
+#define POD_FX_STOMP 0x1
+#define POD_FX_MOD 0x2
+#define POD_FX_DLY 0x3
+#define POD_FX_GATE 0x4
+#define POD_FX_AMP 0x5
+#define POD_FX_WAH 0x6
+#define POD_FX_COUNT 0x7
+
+#define FBVMAP_CHANNEL_COUNT 4
+
+// LED id lookup entries: kind in the upper bits, index in the lower
+#define FBVMAP_LED_COUNT 0x80
+#define FBVMAP_NONE 0x00
+#define FBVMAP_FX 0x80
+#define FBVMAP_CHANNEL 0x40
+#define FBVMAP_TAP 0x20
+#define FBVMAP_KIND_MASK 0xE0
+#define FBVMAP_INDEX(entry) ((entry) & 0x1F)
+
+// indexed by FBV LED id
+extern const uint8_t FBVMAP_LEDS[FBVMAP_LED_COUNT];
+// reverse mappings
+extern const FBVLED FBVMAP_FX_LEDS[POD_FX_COUNT];
+extern const FBVLED FBVMAP_CHANNEL_LEDS[FBVMAP_CHANNEL_COUNT];
+// indexed by BTN_* id
+extern const FBVSwitch FBVMAP_BTN_SWITCHES[IO_BTN_COUNT];
+
+#endif
@@ -0,0 +1,177 @@
+#include "gesture.h"
+#include "timer.h"
+#include <string.h>
+
+#define GESTURE_FLAG_DOWN 0x01
+// the hold was reported, since is the last hold or repeat from then on
+#define GESTURE_FLAG_HELD 0x02
+// went down with its chord partner, a chord once both are held
+#define GESTURE_FLAG_PAIRED 0x04
+// held as a chord, only the release is left to report
+#define GESTURE_FLAG_CHORD 0x08
+
+// since holds the low bits of the time of the press, or of the last hold
+// or repeat once held; enough for any gesture time
+typedef struct gesture_btn_s {
+  uint8_t flags;
+  uint16_t since;
+  // since the hold, for the speed up
+  uint8_t repeats;
+} GestureButton;
+
+typedef struct gesture_engine_s {
+  const GestureConfig* cfgs;
+  GestureCallback callback;
+  GestureButton btns[IO_BTN_COUNT];
+  // the earliest pending hold, repeat or chord
+  Timer due;
+} GestureEngine;
+
+static GestureEngine engine;
+
+static inline uint16_t _elapsed(GestureButton* btn, tick_t now) {
+  return (uint16_t)now - btn->since;
+}
+
+static inline void _emit(uint8_t btn, GestureType gesture, uint8_t other) {
+  if (engine.callback) {
+    (engine.callback)(btn, gesture, other);
+  }
+}
+
+// the repeat time halves every GESTURE_REPEAT_ACCEL repeats
+static uint16_t _repeat_time(GestureButton* btn, const GestureConfig* cfg) {
+  uint16_t time = cfg->repeat;
+  uint8_t i = 0;
+
+  if (!time || !cfg->repeatMin) {
+    return time;
+  }
+  for (i = btn->repeats / GESTURE_REPEAT_ACCEL; i && time / 2 >= cfg->repeatMin; i--) {
+    time /= 2;
+  }
+  return time > cfg->repeatMin ? time : cfg->repeatMin;
+}
+
+// ms until the next thing due on a switch, 0 for nothing
+static uint16_t _next(uint8_t i, tick_t now) {
+  GestureButton* btn = &engine.btns[i];
+  const GestureConfig* cfg = &engine.cfgs[i];
+  uint16_t elapsed = _elapsed(btn, now);
+  uint16_t time = 0;
+
+  if (!(btn->flags & GESTURE_FLAG_DOWN) || (btn->flags & GESTURE_FLAG_CHORD)) {
+    return 0;
+  }
+  if (btn->flags & GESTURE_FLAG_PAIRED) {
+    time = GESTURE_CHORD_HOLD;
+  } else if (btn->flags & GESTURE_FLAG_HELD) {
+    time = _repeat_time(btn, cfg);
+  } else {
+    time = cfg->hold;
+  }
+  if (!time) {
+    return 0;
+  }
+  return elapsed < time ? time - elapsed : 1;
+}
+
+static void _due(tick_t now);
+
+static void _schedule(tick_t now) {
+  uint16_t next = 0;
+  uint16_t delay = 0;
+  uint8_t i = 0;
+
+  for (i = 0; i < IO_BTN_COUNT; i++) {
+    next = _next(i, now);
+    if (next && (!delay || next < delay)) {
+      delay = next;
+    }
+  }
+  if (delay) {
+    TIMER_start(&engine.due, delay, 0, _due);
+  } else {
+    TIMER_stop(&engine.due);
+  }
+}
+
+static void _due(tick_t now) {
+  GestureButton* btn = NULL;
+  const GestureConfig* cfg = NULL;
+  uint8_t i = 0;
+
+  for (i = 0; i < IO_BTN_COUNT; i++) {
+    btn = &engine.btns[i];
+    cfg = &engine.cfgs[i];
+    if (!(btn->flags & GESTURE_FLAG_DOWN) || (btn->flags & GESTURE_FLAG_CHORD)) {
+      continue;
+    }
+    if (btn->flags & GESTURE_FLAG_PAIRED) {
+      // the first one down gets there first
+      if (_elapsed(btn, now) >= GESTURE_CHORD_HOLD) {
+        btn->flags = (btn->flags | GESTURE_FLAG_CHORD) & ~GESTURE_FLAG_PAIRED;
+        engine.btns[cfg->chord].flags =
+          (engine.btns[cfg->chord].flags | GESTURE_FLAG_CHORD) & ~GESTURE_FLAG_PAIRED;
+        _emit(i, GESTURE_CHORD, cfg->chord);
+      }
+    } else if (!(btn->flags & GESTURE_FLAG_HELD)) {
+      if (cfg->hold && _elapsed(btn, now) >= cfg->hold) {
+        btn->flags |= GESTURE_FLAG_HELD;
+        btn->since = (uint16_t)now;
+        btn->repeats = 0;
+        _emit(i, GESTURE_HOLD, GESTURE_NONE);
+      }
+    } else if (cfg->repeat && _elapsed(btn, now) >= _repeat_time(btn, cfg)) {
+      btn->since += _repeat_time(btn, cfg);
+      if (btn->repeats < 0xFF) {
+        btn->repeats++;
+      }
+      _emit(i, GESTURE_REPEAT, GESTURE_NONE);
+    }
+  }
+  _schedule(now);
+}
+
+void GESTURE_initialize(const GestureConfig* cfgs, GestureCallback callback) {
+  memset(&engine, 0, sizeof(GestureEngine));
+  engine.cfgs = cfgs;
+  engine.callback = callback;
+}
+
+// a debounced edge from the button layer, time is when it was seen
+void GESTURE_edge(uint8_t btn_id, uint8_t state, tick_t time) {
+  GestureButton* btn = NULL;
+  GestureButton* partner = NULL;
+  const GestureConfig* cfg = NULL;
+  uint8_t chord = 0;
+
+  if (btn_id >= IO_BTN_COUNT || !engine.cfgs) {
+    return;
+  }
+  btn = &engine.btns[btn_id];
+  cfg = &engine.cfgs[btn_id];
+  chord = cfg->chord;
+  partner = chord < IO_BTN_COUNT ? &engine.btns[chord] : NULL;
+
+  if (state) {
+    btn->flags |= GESTURE_FLAG_DOWN;
+    _emit(btn_id, GESTURE_PRESS, GESTURE_NONE);
+    // the partner went down just before and wasn't held yet
+    if (partner && (partner->flags & GESTURE_FLAG_DOWN) &&
+        !(partner->flags & (GESTURE_FLAG_HELD|GESTURE_FLAG_CHORD)) &&
+        _elapsed(partner, time) <= GESTURE_CHORD_WINDOW) {
+      partner->flags |= GESTURE_FLAG_PAIRED;
+      btn->flags |= GESTURE_FLAG_PAIRED;
+    }
+    btn->since = (uint16_t)time;
+  } else if (btn->flags & GESTURE_FLAG_DOWN) {
+    if (partner && (btn->flags & GESTURE_FLAG_PAIRED)) {
+      // let go before the chord, the partner holds on its own
+      partner->flags &= ~GESTURE_FLAG_PAIRED;
+    }
+    _emit(btn_id, GESTURE_RELEASE, GESTURE_NONE);
+    btn->flags = 0;
+  }
+  _schedule(time);
+}
@@ -0,0 +1,45 @@
+#ifndef _GESTURE_H_INCLUDED_
+#define _GESTURE_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// how long the second switch of a chord may come after the first, in ms
+#define GESTURE_CHORD_WINDOW 60
+// and how long both are held down then
+#define GESTURE_CHORD_HOLD BTN_HOLD_TIME
+// no chord partner
+#define GESTURE_NONE 0xFF
+// repeats before the repeat time halves again, down to repeatMin
+#define GESTURE_REPEAT_ACCEL 4
+
+typedef enum gesture_type_e
+  {
+   GESTURE_PRESS = 0,
+   GESTURE_RELEASE,
+   // held for the hold time, once a press
+   GESTURE_HOLD,
+   // every repeat time after the hold while still down
+   GESTURE_REPEAT,
+   // both switches of a pair went down together and were held; other is
+   // the second one. Neither holds nor repeats follow for them
+   GESTURE_CHORD
+  } GestureType;
+
+// times in ms, 0 disables the gesture. Presses are reported at once, chord
+// partners included, so what a chord's presses did must be easy to undo
+// when the chord comes. Repeats speed up from repeat to repeatMin, a
+// repeatMin of 0 keeps them steady
+typedef struct gesture_cfg_s {
+  uint16_t hold;
+  uint16_t repeat;
+  uint16_t repeatMin;
+  uint8_t chord;
+} GestureConfig;
+
+typedef void (*GestureCallback)(uint8_t btn, GestureType gesture, uint8_t other);
+
+void GESTURE_initialize(const GestureConfig* cfgs, GestureCallback callback);
+void GESTURE_edge(uint8_t btn, uint8_t state, tick_t time);
+
+#endif
@@ -1,9 +1,10 @@
 #include "io.h"
 #include "config.h"
-#include "tick.h"
+#include "timer.h"
 #include <string.h>
 #ifdef VIRTUAL_HW
 #include <stdio.h>
+#include "virtual.h"
 #endif
 
 
@@ -11,27 +12,42 @@ typedef struct btn_control_s {
   BTNEventCallback evtCb;
   uint32_t buttonStates;
   uint8_t transientStates[IO_BTN_COUNT];
-  tick_t lastCycle;
+  Timer poll;
 } BTNStateControl;
 
+#ifndef VIRTUAL_HW
+// LED outputs as last written
+typedef struct led_control_s {
+  uint32_t states;
+  uint8_t written;
+} LEDState;
+#endif
+
 typedef struct exp_pedal_s {
   uint16_t expValues;
-  tick_t lastCycle;
+  EXPEventCallback evtCb;
+  Timer poll;
 } EXPState;
 
 static BTNStateControl btns;
 static EXPState _exp;
+#ifndef VIRTUAL_HW
+static LEDState leds;
+#endif
+
+static void _btns_poll(tick_t now);
+static void _exp_poll(tick_t now);
 
 void BTNS_initialize(BTNEventCallback callback) {
+  memset(&btns, 0, sizeof(BTNStateControl));
   btns.evtCb = callback;
-  btns.buttonStates = 0;
-  btns.lastCycle = 0;
-  memset(btns.transientStates, 0, IO_BTN_COUNT);
+  TIMER_start(&btns.poll, BTN_POLL_INTERVAL, BTN_POLL_INTERVAL, _btns_poll);
 }
 
-void EXP_initialize(void) {
-  _exp.expValues = 0;
-  _exp.lastCycle = 0;
+void EXP_initialize(EXPEventCallback callback) {
+  memset(&_exp, 0, sizeof(EXPState));
+  _exp.evtCb = callback;
+  TIMER_start(&_exp.poll, EXP_POLL_INTERVAL, EXP_POLL_INTERVAL, _exp_poll);
 }
 
 uint32_t BTNS_get_state(void) {
@@ -41,7 +57,7 @@ uint32_t BTNS_get_state(void) {
 static uint32_t _read_btns(void) {
   // do something
 #ifdef VIRTUAL_HW
-  return 0;
+  return VIRTUAL_btn_states();
 #else
   unsigned int i = 0;
   uint32_t states = 0;
@@ -56,17 +72,16 @@ static uint32_t _read_btns(void) {
 
 static uint32_t _read_exp(void) {
   // do something
+#ifdef VIRTUAL_HW
+  return VIRTUAL_exp_values();
+#else
   return 0;
+#endif
 }
 
-void BTNS_cycle(void) {
+static void _btns_poll(tick_t now) {
   unsigned int i = 0;
   uint32_t btn_state = 0;
-  tick_t now = 0;
-  now = TICK_get();
-  if (now - btns.lastCycle < BTN_POLL_INTERVAL) {
-    return;
-  }
 
   btn_state = _read_btns();
   for (i=0; i<IO_BTN_COUNT;i++) {
@@ -87,30 +102,39 @@ void BTNS_cycle(void) {
         btns.transientStates[i] = 0;
         // call event callback
         if (btns.evtCb) {
-          (btns.evtCb)(i, (btn_state & (1<<i) ? 1: 0));
+          (btns.evtCb)(i, (btn_state & (1<<i) ? 1: 0), now);
         }
       }
     }
   }
-  btns.lastCycle = now;
 }
 
-void EXP_cycle(void) {
-  tick_t now = 0;
-  now = TICK_get();
-  if (now - _exp.lastCycle < EXP_POLL_INTERVAL) {
+static void _exp_poll(tick_t now) {
+  uint16_t values = (uint16_t)_read_exp();
+  (void)now;
+
+  if (values == _exp.expValues) {
     return;
   }
-  _exp.expValues = _read_exp();
-  _exp.lastCycle = now;
+  _exp.expValues = values;
+  if (_exp.evtCb) {
+    (_exp.evtCb)(values);
+  }
 }
 
 void LEDS_set_state(uint32_t led_states) {
 #ifdef VIRTUAL_HW
-  // printf("SET LED STATES: %x\n", led_states);
+  VIRTUAL_leds(led_states);
 #else
   unsigned int i = 0;
+  // only the pins that change, all of them the first time
+  uint32_t changed = leds.written ? led_states ^ leds.states : ~0UL;
+  leds.states = led_states;
+  leds.written = 1;
   for(i=0;i<CONFIG_LED_COUNT;i++) {
+    if (!(changed & (1<<i))) {
+      continue;
+    }
     if (led_states & (1<<i)) {
       gpio_set(LED_PORTS[i], LED_PINS[i]);
     } else {
@@ -2,6 +2,7 @@
 #define _IO_H_INCLUDED_
 
 #include <stdint.h>
+#include "config.h"
 
 // Button defintions (order)
 
@@ -23,20 +24,21 @@
 #define EXP_2 0x1
 
 
-// Button event callbakk
-typedef void (*BTNEventCallback)(uint8_t, uint8_t);
+// Button event callbakk, with the time the edge was seen
+typedef void (*BTNEventCallback)(uint8_t, uint8_t, tick_t);
 
 // Button functions
 void BTNS_initialize(BTNEventCallback callback);
 uint32_t BTNS_get_state(void);
-void BTNS_cycle(void);
 
 // LED functions
 void LEDS_set_state(uint32_t led_states);
 
+// Expression pedal callback, with both values as EXP_get_values
+typedef void (*EXPEventCallback)(uint16_t);
+
 // Expression pedals
-void EXP_initialize(void);
-void EXP_cycle(void);
+void EXP_initialize(EXPEventCallback callback);
 uint16_t EXP_get_values(void);
 
 #endif
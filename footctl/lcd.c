@@ -1,5 +1,6 @@
 #include "lcd.h"
 #include "tick.h"
+#include <string.h>
 #include <libopencm3/stm32/gpio.h>
 
 #define LCD_CMD_CLEAR 0x01
@@ -24,6 +25,9 @@
 
 const uint8_t ROWS[] = {0x00, 0x40};
 
+// what the display shows, only the differences are written
+static LCDContents shown;
+
 inline static void _delay_ns(uint32_t amount) {
   volatile uint32_t cycles = 0;
   if (amount < DELAY_NS) {
@@ -92,18 +96,33 @@ void LCD_initialize(void) {
   _lcd_write_cmd(LCD_CMD_CLEAR);
   _lcd_write_cmd(LCD_CMD_DISP|LCD_DISP_ON);
   _lcd_write_cmd(LCD_CMD_MODE|LCD_MODE_I);
+  // cleared to blanks
+  memset(shown, 0x20, sizeof(LCDContents));
 }
 
+// writes the characters that changed; the address increments after
+// each, so the cursor is only moved past unchanged ones
 void LCD_draw(LCDContents* contents) {
   unsigned int i =0, j = 0;
+  uint8_t placed = 0;
+  char c = 0;
   if (!contents) {
     return;
   }
   for (i=0;i<LCD_ROWS;i++) {
-    _lcd_cursor(i, 0);
+    placed = 0;
     for (j=0;j<LCD_COLS;j++) {
-      _lcd_write_data(*((char*)contents + LCD_COLS*i + j));
+      c = (*contents)[i][j];
+      if (c == shown[i][j]) {
+        placed = 0;
+        continue;
+      }
+      if (!placed) {
+        _lcd_cursor(i, j);
+        placed = 1;
+      }
+      _lcd_write_data(c);
+      shown[i][j] = c;
     }
   }
-
 }
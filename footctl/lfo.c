@@ -0,0 +1,170 @@
+#include "lfo.h"
+#include <string.h>
+
+#define LFO_FLAG_RUNNING 0x01
+// a swell reached its end
+#define LFO_FLAG_DONE 0x02
+
+// ms per 1/24 beat is 25000 / bpm10
+#define LFO_TICK_SCALE 25000UL
+// no value queued since the LFO started
+#define LFO_VALUE_NONE 0xFF
+
+// a quarter sine wave, 0 to 90 degrees in 64 steps
+static const uint8_t LFO_SINE_TABLE[65] =
+  {
+   0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37,
+   40, 43, 46, 49, 51, 54, 57, 60, 63, 65, 68, 71, 73,
+   76, 78, 81, 83, 85, 88, 90, 92, 94, 96, 98, 100, 102,
+   104, 106, 107, 109, 111, 112, 113, 115, 116, 117, 118, 120, 121,
+   122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127, 127
+  };
+
+// phase is a 32 bit fraction of the period, step its advance per ms
+typedef struct lfo_s {
+  LFOConfig cfg;
+  uint8_t flags;
+  uint8_t held;
+  uint8_t lastValue;
+  uint32_t phase;
+  uint32_t step;
+  tick_t last;
+} LFO;
+
+typedef struct lfo_engine_s {
+  LFO lfos[LFO_COUNT];
+  uint16_t bpm10;
+  uint32_t seed;
+} LFOEngine;
+
+static LFOEngine engine;
+
+static void _update_step(LFO* lfo) {
+  if (!lfo->cfg.period) {
+    lfo->step = 0;
+    return;
+  }
+  lfo->step = (uint32_t)(((uint64_t)engine.bpm10 << 32) /
+                         ((uint32_t)lfo->cfg.period * LFO_TICK_SCALE));
+}
+
+void LFO_initialize(void) {
+  memset(&engine, 0, sizeof(LFOEngine));
+  engine.bpm10 = LFO_DEFAULT_BPM10;
+  engine.seed = 1;
+}
+
+void LFO_configure(uint8_t id, const LFOConfig* cfg) {
+  if (id >= LFO_COUNT || !cfg) {
+    return;
+  }
+  engine.lfos[id].cfg = *cfg;
+  _update_step(&engine.lfos[id]);
+}
+
+// keeps the phase, so a running LFO follows a new tempo without a jump
+void LFO_set_tempo(uint16_t bpm10) {
+  uint8_t i = 0;
+
+  if (!bpm10) {
+    return;
+  }
+  engine.bpm10 = bpm10;
+  for (i = 0; i < LFO_COUNT; i++) {
+    _update_step(&engine.lfos[i]);
+  }
+}
+
+void LFO_start(uint8_t id, tick_t now) {
+  LFO* lfo = NULL;
+
+  if (id >= LFO_COUNT) {
+    return;
+  }
+  lfo = &engine.lfos[id];
+  lfo->flags = LFO_FLAG_RUNNING;
+  lfo->phase = 0;
+  lfo->last = now;
+  lfo->lastValue = LFO_VALUE_NONE;
+  engine.seed ^= (uint32_t)now;
+  lfo->held = (uint8_t)(engine.seed >> 24);
+}
+
+// the control stays where the LFO left it
+void LFO_stop(uint8_t id) {
+  if (id < LFO_COUNT) {
+    engine.lfos[id].flags = 0;
+  }
+}
+
+uint8_t LFO_is_running(uint8_t id) {
+  return id < LFO_COUNT && (engine.lfos[id].flags & LFO_FLAG_RUNNING);
+}
+
+// wave position from 0 to 255
+static uint8_t _wave(LFO* lfo) {
+  uint8_t index = (uint8_t)(lfo->phase >> 24);
+  uint8_t pos = index & 0x3F;
+
+  switch (lfo->cfg.shape) {
+  case LFO_SINE:
+    switch (index >> 6) {
+    case 0:
+      return 128 + LFO_SINE_TABLE[pos];
+    case 1:
+      return 128 + LFO_SINE_TABLE[64 - pos];
+    case 2:
+      return 128 - LFO_SINE_TABLE[pos];
+    default:
+      return 128 - LFO_SINE_TABLE[64 - pos];
+    }
+  case LFO_TRIANGLE:
+    return index < 128 ? index << 1 : (255 - index) << 1;
+  case LFO_SQUARE:
+    return index < 128 ? 255 : 0;
+  case LFO_SAMPLE_HOLD:
+    return lfo->held;
+  case LFO_SWELL:
+    return (lfo->flags & LFO_FLAG_DONE) ? 255 : index;
+  default:
+    return 0;
+  }
+}
+
+static void _advance(LFO* lfo, tick_t now) {
+  uint32_t phase = lfo->phase + lfo->step * (uint32_t)(now - lfo->last);
+
+  lfo->last = now;
+  // updates are far more frequent than the shortest period, so a
+  // smaller phase means exactly one wrap
+  if (phase < lfo->phase) {
+    engine.seed = engine.seed * 1664525UL + 1013904223UL;
+    lfo->held = (uint8_t)(engine.seed >> 24);
+    lfo->flags |= LFO_FLAG_DONE;
+  }
+  lfo->phase = phase;
+}
+
+// call every LFO_UPDATE_INTERVAL. values go through libpod's coalescing
+// slots: when the line is busy only the latest one is sent, within the CC
+// budget and after footswitches
+void LFO_cycle(tick_t now) {
+  LFO* lfo = NULL;
+  int16_t range = 0;
+  uint8_t value = 0;
+  uint8_t i = 0;
+
+  for (i = 0; i < LFO_COUNT; i++) {
+    lfo = &engine.lfos[i];
+    if (!(lfo->flags & LFO_FLAG_RUNNING)) {
+      continue;
+    }
+    _advance(lfo, now);
+    range = (int16_t)lfo->cfg.max - lfo->cfg.min;
+    value = (uint8_t)(lfo->cfg.min + range * _wave(lfo) / 255);
+    if (value != lfo->lastValue) {
+      POD_queue_control(lfo->cfg.ctl, value);
+      lfo->lastValue = value;
+    }
+  }
+}
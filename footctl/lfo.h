@@ -0,0 +1,45 @@
+#ifndef _LFO_H_INCLUDED_
+#define _LFO_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+#include "pod.h"
+
+// each running LFO takes one of libpod's POD_CC_SLOT_COUNT slots, two are
+// left to the pedals
+#define LFO_COUNT 2
+// ms between updates; values in between would be coalesced away anyway
+#define LFO_UPDATE_INTERVAL 5
+// tempo used until one is tapped
+#define LFO_DEFAULT_BPM10 1200
+
+typedef enum lfo_shape_e
+  {
+   LFO_SINE = 0,
+   LFO_TRIANGLE,
+   LFO_SQUARE,
+   // a random value held for each period
+   LFO_SAMPLE_HOLD,
+   // one shot envelope from min to max over a period, then held
+   LFO_SWELL
+  } LFOShape;
+
+// period is in 1/24 beats, like MIDI clock: 24 is a beat, 96 a 4/4 bar.
+// max below min inverts the wave
+typedef struct lfo_cfg_s {
+  PODControlType ctl;
+  LFOShape shape;
+  uint16_t period;
+  uint8_t min;
+  uint8_t max;
+} LFOConfig;
+
+void LFO_initialize(void);
+void LFO_configure(uint8_t id, const LFOConfig* cfg);
+void LFO_set_tempo(uint16_t bpm10);
+void LFO_start(uint8_t id, tick_t now);
+void LFO_stop(uint8_t id);
+uint8_t LFO_is_running(uint8_t id);
+void LFO_cycle(tick_t now);
+
+#endif
@@ -4,42 +4,52 @@
 #include "manager.h"
 #include "io.h"
 #include "tick.h"
+#include "serial.h"
+#include "fbvmap.h"
+#include "tempo.h"
+#include "clock.h"
+#include "presets.h"
+#include "lfo.h"
+#include "automation.h"
+#include "timer.h"
+#include "gesture.h"
+#include "lcd.h"
 #include <string.h>
 #ifdef VIRTUAL_HW
 #include <stdio.h>
 #include "virtual.h"
-#else
-#include <libopencm3/stm32/usart.h>
-#include "lcd.h"
 #endif
 
-// setup togglable FX bits for internal state
-#define POD_FX_EQ 0x0
-#define POD_FX_STOMP 0x1
-#define POD_FX_MOD 0x2
-#define POD_FX_DLY 0x3
-#define POD_FX_GATE 0x4
-#define POD_FX_AMP 0x5
-#define POD_FX_WAH 0x6
-#define POD_FX_COUNT 0x7
-#define POD_INVALID_FX 0xFF
-
 // Channel LEDs
-#define LED_CHANNEL_A 0x0
-#define LED_CHANNEL_B 0x1
-#define LED_CHANNEL_C 0x2
-#define LED_CHANNEL_D 0x3
-#define LED_TAP 0xff
-#define LED_TUNER 0xff
-#define LED_COUNT 0x4
-#define LED_INVALID 0xFF
+#define LED_COUNT FBVMAP_CHANNEL_COUNT
+// FX LEDs follow; the board has no tap LED, the delay LED, the effect
+// that follows the tempo, blinks inverted on the beat instead
+#define LED_TAP (LED_COUNT + POD_FX_DLY)
 
 // build a few tables for FX state management
 static const PODTogglableFX POD_FX_CONTROLS[POD_FX_COUNT] =
   {BOD_FX_EQ, BOD_FX_STOMP, BOD_FX_MOD, BOD_FX_DLYREV,
    BOD_FX_GATE, BOD_FX_AMP, BOD_FX_WAH};
 
-// tables for LED management
+static const LFOConfig LFO_CONFIGS[LFO_COUNT] =
+  {{LFO1_CC, LFO1_SHAPE, LFO1_PERIOD, LFO1_MIN, LFO1_MAX},
+   {LFO2_CC, LFO2_SHAPE, LFO2_PERIOD, LFO2_MIN, LFO2_MAX}};
+// the effect each LFO runs with
+static const uint8_t LFO_GATES[LFO_COUNT] = {LFO1_GATE, LFO2_GATE};
+
+#define CHORD_PARTNER(btn) ((btn) == AUTOMATION_CHORD_A ? AUTOMATION_CHORD_B : \
+                            (btn) == AUTOMATION_CHORD_B ? AUTOMATION_CHORD_A : GESTURE_NONE)
+#define PLAIN_SWITCH(btn) {0, 0, 0, CHORD_PARTNER(btn)}
+#define BROWSE_SWITCH(btn) {BROWSE_REPEAT_DELAY, BROWSE_REPEAT_RATE, BROWSE_REPEAT_FASTEST, \
+                            CHORD_PARTNER(btn)}
+// footswitch gestures, in button order
+static const GestureConfig GESTURE_CONFIGS[IO_BTN_COUNT] =
+  {PLAIN_SWITCH(BTN_CHA), PLAIN_SWITCH(BTN_CHB), PLAIN_SWITCH(BTN_CHC), PLAIN_SWITCH(BTN_CHD),
+   PLAIN_SWITCH(BTN_EQ), PLAIN_SWITCH(BTN_STOMP), PLAIN_SWITCH(BTN_MOD), PLAIN_SWITCH(BTN_DLY),
+   // held to scroll through the banks
+   BROWSE_SWITCH(BTN_UP), BROWSE_SWITCH(BTN_DN), PLAIN_SWITCH(BTN_WAH),
+   // held for the tuner
+   {BTN_HOLD_TIME, 0, 0, CHORD_PARTNER(BTN_TAP)}};
 
 // internal flags
 #define FLAG_WAIT_POD 0x01
@@ -52,120 +62,210 @@ static const PODTogglableFX POD_FX_CONTROLS[POD_FX_COUNT] =
 #define FLAG_FIRST_PING 0x80
 
 // #define POD_RESPOND_PINGS
-#define MAIN_LOOP_INTERVAL 1
-#define PROBE_INTERVAL_MULT 300
-#define BTN_HOLD_THRESH 500
+// pedal values the FBV line had no room for are tried again this often
+#define EXP_RETRY_INTERVAL 1
+// and queued MIDI the budget or the line held back
+#define POD_SERVICE_INTERVAL 1
+// ms between pings until the POD answered
+#define PROBE_INTERVAL 300
+// leave tuner mode when the POD stops reporting
+#define TUNER_TIMEOUT 1000
 
-#define MSG_QUEUE_LEN 8
+#define RX_CHUNK_SIZE 16
+// the POD's answer to a program change is complete once it went quiet
+#define PRESET_SETTLE 50
+// what a press is expected to do is shown until the POD confirms it or
+// this many ms passed
+#define PREDICTION_TIMEOUT 500
+// FBV frames are applied to LEDs and display together once the line has
+// been quiet this long, or at the latest after FBV_BURST_MAX
+#define FBV_BURST_QUIET 3
+#define FBV_BURST_MAX 20
+// switch reports waiting for room on the FBV line, retried every ms
+#define FBV_PENDING_SIZE 8
 
 #ifdef POD_RESPOND_PINGS
 static const uint8_t FBV_PINGBACK[] = {0x00, 0x02, 0x00, 0x01, 0x01, 0x00};
 #endif
 static const char INITIAL_TEXT[2][16] = {"                ", "Initializing... "};
 
+// a press shown ahead of the POD's answer
+typedef struct prediction_s {
+  // FX toggled and not echoed yet
+  uint8_t fx;
+  // program + 1 asked for and not settled yet
+  uint8_t program;
+  // bank or channel came back since
+  uint8_t answered;
+  // what was shown before the oldest pending prediction
+  uint8_t fxState;
+  uint8_t ledState;
+  uint8_t actualProgram;
+  char currentProgram[3];
+  char currentText[16];
+  Timer timeout;
+} Prediction;
+
+// a bank picked with UP/DN, not sent to the POD yet
+typedef struct browse_s {
+  uint8_t active;
+  uint8_t bank;
+  Timer idle;
+  // chord switches down, and how it was before the first of them
+  uint8_t chordDown;
+  uint8_t savedActive;
+  uint8_t savedBank;
+} Browse;
+
+// FBV frames not shown yet
+typedef struct fbv_burst_s {
+  uint8_t open;
+  tick_t first;
+  // last byte received
+  tick_t last;
+} FBVBurst;
+
+// switch reports the FBV line had no room for, sent in order
+typedef struct fbv_pending_s {
+  uint8_t switches[FBV_PENDING_SIZE];
+  uint8_t states[FBV_PENDING_SIZE];
+  uint8_t head;
+  uint8_t count;
+  Timer retry;
+} FBVPending;
+
 typedef struct manager_s {
   uint8_t fxState;
   uint8_t otherLedState;
+  uint32_t ledsShown;
   uint8_t flags;
   uint8_t actualProgram;
   char currentProgram[3];
   char currentText[16];
-  uint32_t mainCycleTimer;
-  uint32_t btnStates;
-  uint16_t btnHoldCount[IO_BTN_COUNT];
+  char tunerNote;
+  uint8_t tunerFlat;
+  tick_t tunerLastSeen;
+  tick_t presetSeen;
+  // a TAP press counts on release, a hold is the tuner instead
+  uint8_t tapPending;
+  tick_t tapAt;
+  // housekeeping runs when something changed, or when it's next due
+  Timer housekeeping;
+  tick_t housekeepingDue;
+  Timer service;
+  Timer probe;
+  Timer lfoUpdate;
+  Prediction predict;
+  FBVBurst burst;
+  FBVPending pending;
+  Browse browse;
   uint16_t expValues;
-  FBVMessage msgQueue[MSG_QUEUE_LEN];
-  uint8_t msgQueueWr;
-  uint8_t msgQueueRd;
 } Manager;
 
 static Manager mgr;
 
-static uint8_t _queue_len(void) {
-  if (mgr.msgQueueWr > mgr.msgQueueRd) {
-    return mgr.msgQueueWr - mgr.msgQueueRd;
-  } else {
-    return mgr.msgQueueRd - mgr.msgQueueWr;
+static void _housekeeping(tick_t now);
+static void _pod_service(tick_t now);
+static void _probe_pod(tick_t now);
+static void _run_lfos(tick_t now);
+static void _prediction_expired(tick_t now);
+static void _browse_idle(tick_t now);
+static void _fbv_retry(tick_t now);
+
+static FBVTxResult _fbv_msg(FBVMessageType cmd, uint8_t paramSize, uint8_t* params) {
+  FBVMessage msg;
+  // use a trick here for easier handling
+  msg.msgType = cmd;
+  if (paramSize == 1) {
+    msg.params[0] = (uint8_t)((uint32_t)params);
+    msg.paramSize = 1;
+  }
+  else {
+    memcpy(&msg.params, params, paramSize);
+    msg.paramSize = paramSize;
   }
+  return FBV_send_msg(&msg);
 }
 
-/* static void _queue_in(FBVMessage msg) { */
-/*   mgr.msgQueue[mgr.msgQueueWr] = msg; */
+// native FBV events, as sent by a genuine FBV
+static inline FBVTxResult _fbv_send_switch(uint8_t sw, uint8_t state) {
+  uint8_t params[2];
+  params[0] = sw;
+  params[1] = state;
+  return _fbv_msg(FBV_BTN_STAT, 2, params);
+}
 
-/*   if (mgr.msgQueueWr == (MSG_QUEUE_LEN - 1)) { */
-/*     mgr.msgQueueWr = 0; */
-/*   } else { */
-/*     mgr.msgQueueWr++; */
-/*   } */
-/* } */
+// older reports go first, so a press never lands after its release
+static void _fbv_report_switch(uint8_t btn_id, uint8_t state) {
+  FBVPending* pending = &mgr.pending;
+  uint8_t i = 0;
 
-static uint8_t _queue_out(FBVMessage* msg) {
-  if (!msg) {
-    return 0;
+  if (!pending->count && _fbv_send_switch(FBVMAP_BTN_SWITCHES[btn_id], state ? 1 : 0) == FBV_TX_OK) {
+    return;
   }
-  if (_queue_len() == 0) {
-     return 0;
+  if (pending->count == FBV_PENDING_SIZE) {
+    // line stuck, keep the oldest
+    return;
   }
-  *msg = mgr.msgQueue[mgr.msgQueueRd];
-  if (mgr.msgQueueRd == (MSG_QUEUE_LEN - 1)) {
-    mgr.msgQueueRd = 0;
-  } else {
-    mgr.msgQueueRd++;
+  i = (pending->head + pending->count) % FBV_PENDING_SIZE;
+  pending->switches[i] = FBVMAP_BTN_SWITCHES[btn_id];
+  pending->states[i] = state ? 1 : 0;
+  pending->count++;
+  if (!TIMER_is_active(&pending->retry)) {
+    TIMER_start(&pending->retry, 1, 1, _fbv_retry);
   }
-  return 1;
 }
 
-static uint8_t _fbv_led_to_fx(FBVLED ledId) {
-  switch (ledId) {
-  case FBV_LED_MOD:
-    return POD_FX_MOD;
-  case FBV_LED_SB1:
-    return POD_FX_STOMP;
-  case FBV_LED_SB2:
-    return POD_FX_EQ;
-  case FBV_LED_SB3:
-    return POD_FX_GATE;
-  case FBV_LED_DLY:
-    return POD_FX_DLY;
-  case FBV_LED_AMP:
-    return POD_FX_AMP;
-  case FBV_LED_WAH:
-    return POD_FX_WAH;
-  default:
-    return POD_INVALID_FX;
-  }
-}
-
-static uint8_t _fbv_led_to_internal(FBVLED ledId) {
-  switch(ledId) {
-  case FBV_LED_CHA:
-    return LED_CHANNEL_A;
-  case FBV_LED_CHB:
-    return LED_CHANNEL_B;
-  case FBV_LED_CHC:
-    return LED_CHANNEL_C;
-  case FBV_LED_CHD:
-    return LED_CHANNEL_D;
-  case FBV_LED_TAP:
-    return LED_TAP;
-  default:
-    return LED_INVALID;
+static void _fbv_retry(tick_t now) {
+  FBVPending* pending = &mgr.pending;
+  (void)now;
+
+  while (pending->count &&
+      _fbv_send_switch(pending->switches[pending->head], pending->states[pending->head]) == FBV_TX_OK) {
+    pending->head = (pending->head + 1) % FBV_PENDING_SIZE;
+    pending->count--;
+  }
+  if (!pending->count) {
+    TIMER_stop(&pending->retry);
   }
 }
 
-static void _fbv_msg(FBVMessageType cmd, uint8_t paramSize, uint8_t* params) {
-  FBVMessage msg;
-  // use a trick here for easier handling
-  msg.msgType = cmd;
-  if (paramSize == 1) {
-    msg.params[0] = (uint8_t)((uint32_t)params);
-    msg.paramSize = 1;
+static inline FBVTxResult _fbv_report_control(FBVControl ctl, uint8_t value) {
+  uint8_t params[2];
+  params[0] = ctl;
+  params[1] = value;
+  return _fbv_msg(FBV_CTL_STAT, 2, params);
+}
+
+// run housekeeping in delay ms, unless it's due sooner already
+static void _housekeeping_in(uint32_t delay) {
+  tick_t due = TICK_get() + delay;
+
+  if (TIMER_is_active(&mgr.housekeeping) && mgr.housekeepingDue <= due) {
+    return;
   }
-  else {
-    memcpy(&msg.params, params, paramSize);
-    msg.paramSize = paramSize;
+  mgr.housekeepingDue = due;
+  TIMER_start(&mgr.housekeeping, delay, 0, _housekeeping);
+}
+
+// remember what was shown before, unless an older prediction did
+static void _predict(void) {
+  Prediction* predict = &mgr.predict;
+
+  if (!predict->fx && !predict->program) {
+    predict->fxState = mgr.fxState;
+    predict->ledState = mgr.otherLedState;
+    predict->actualProgram = mgr.actualProgram;
+    memcpy(predict->currentProgram, mgr.currentProgram, 3);
+    memcpy(predict->currentText, mgr.currentText, 16);
+  }
+  TIMER_start(&predict->timeout, PREDICTION_TIMEOUT, 0, _prediction_expired);
+}
+
+static inline void _predict_done(void) {
+  if (!mgr.predict.fx && !mgr.predict.program) {
+    TIMER_stop(&mgr.predict.timeout);
   }
-  FBV_send_msg(&msg);
 }
 
 static void _pod_fx_set_state(uint8_t fxId, uint8_t state, uint8_t user) {
@@ -173,6 +273,18 @@ static void _pod_fx_set_state(uint8_t fxId, uint8_t state, uint8_t user) {
     return;
   }
 
+  // emit MIDI message
+  if (user) {
+    POD_set_fx_state(POD_FX_CONTROLS[fxId], state);
+    AUTOMATION_add(state ? AUTOMATION_FX_ON : AUTOMATION_FX_OFF, fxId, TICK_get());
+    if (!OPTIMISTIC_FEEDBACK) {
+      // the LED follows the POD's echo
+      return;
+    }
+    _predict();
+    mgr.predict.fx |= (1<<fxId);
+  }
+
   // set local state
   if (state) {
     mgr.fxState |= (1<<fxId);
@@ -180,11 +292,6 @@ static void _pod_fx_set_state(uint8_t fxId, uint8_t state, uint8_t user) {
   else {
     mgr.fxState &= ~(1<<fxId);
   }
-
-  // emit MIDI message
-  if (user) {
-    POD_set_fx_state(POD_FX_CONTROLS[fxId], state);
-  }
 }
 
 static void _pod_fx_toggle_state(uint8_t fxId, uint8_t user) {
@@ -200,8 +307,205 @@ static void _pod_fx_toggle_state(uint8_t fxId, uint8_t user) {
   }
 }
 
+static void _set_led_state(uint8_t ledId, uint8_t state);
+
+// show a program right away, with its name and FX states if cached; the
+// POD's answer confirms or corrects it
+static void _preset_preview(uint8_t program) {
+  uint8_t fxState = 0;
+  uint8_t bank = program / 4 + 1;
+  uint8_t i = 0;
+
+  if (program == mgr.actualProgram) {
+    // libpod doesn't repeat it, nothing will answer
+    return;
+  }
+  _predict();
+  mgr.predict.program = program + 1;
+  mgr.predict.answered = 0;
+  if (PRESETS_lookup(program, mgr.currentText, &fxState)) {
+    mgr.fxState = fxState;
+    // the POD reloads them all
+    mgr.predict.fx = 0;
+  } else {
+    // not someone else's name
+    memcpy(mgr.currentText, INITIAL_TEXT[0], 16);
+  }
+  mgr.actualProgram = program;
+  mgr.currentProgram[0] = bank >= 10 ? '0' + bank / 10 : ' ';
+  mgr.currentProgram[1] = '0' + bank % 10;
+  mgr.currentProgram[2] = 'A' + program % 4;
+  for (i = 0; i < LED_COUNT; i++) {
+    _set_led_state(i, i == program % 4);
+  }
+  mgr.flags |= FLAG_DISPLAY_DIRTY;
+#ifdef VIRTUAL_HW
+  printf("VFBV: preview program %u '%.16s'\n", program, mgr.currentText);
+#endif
+}
+
+// the POD's state for the current program after it settled
+static void _preset_touch(void) {
+  mgr.presetSeen = TICK_get();
+}
+
+// bank or channel from the POD, so it acted on the program change
+static inline void _program_touch(void) {
+  _preset_touch();
+  mgr.predict.answered = 1;
+}
+
+// its answer is complete: the digits are the POD's by now
+static void _program_settled(void) {
+  if (!mgr.predict.program || !mgr.predict.answered) {
+    return;
+  }
+#ifdef VIRTUAL_HW
+  printf("VFBV: program prediction %s\n",
+         mgr.predict.program == mgr.actualProgram + 1 ? "confirmed" : "corrected");
+#endif
+  mgr.predict.program = 0;
+  _predict_done();
+}
+
+// the POD didn't answer: show what it still has
+static void _prediction_expired(tick_t now) {
+  Prediction* predict = &mgr.predict;
+  uint8_t i = 0;
+  (void)now;
+
+  if (predict->program) {
+    predict->fx = mgr.fxState ^ predict->fxState;
+    mgr.otherLedState = predict->ledState;
+    mgr.actualProgram = predict->actualProgram;
+    memcpy(mgr.currentProgram, predict->currentProgram, 3);
+    memcpy(mgr.currentText, predict->currentText, 16);
+    POD_set_program_shadow(mgr.actualProgram + 1);
+  }
+  for (i = 0; i < POD_FX_COUNT; i++) {
+    if (predict->fx & (1<<i)) {
+      POD_set_control_shadow((PODControlType)POD_FX_CONTROLS[i],
+                             (predict->fxState & (1<<i)) ? 0x7f : 0x00);
+    }
+  }
+  mgr.fxState = (mgr.fxState & ~predict->fx) | (predict->fxState & predict->fx);
+  predict->fx = 0;
+  predict->program = 0;
+  _housekeeping_in(0);
+  mgr.flags |= FLAG_DISPLAY_DIRTY;
+#ifdef VIRTUAL_HW
+  printf("VFBV: no answer from the POD, prediction rolled back\n");
+#endif
+}
+
 static inline void _pod_activate_program(uint8_t program) {
   POD_change_program(program);
+  AUTOMATION_add(AUTOMATION_PROGRAM, program, TICK_get());
+  // PC 0 is manual mode, the cache starts at bank 1 channel A
+  if (program && OPTIMISTIC_FEEDBACK) {
+    _preset_preview(program - 1);
+  }
+}
+
+static void _browse_end(void) {
+  if (mgr.browse.active) {
+    TIMER_stop(&mgr.browse.idle);
+    mgr.browse.active = 0;
+    mgr.flags |= FLAG_DISPLAY_DIRTY;
+  }
+}
+
+// move the bank shown, from the one playing; nothing goes to the POD
+static void _browse_step(uint8_t up) {
+  if (!mgr.browse.active) {
+    mgr.browse.active = 1;
+    mgr.browse.bank = mgr.actualProgram / 4;
+  }
+  if (BROWSE_TIMEOUT) {
+    TIMER_start(&mgr.browse.idle, BROWSE_TIMEOUT, 0, _browse_idle);
+  }
+  mgr.flags |= FLAG_DISPLAY_DIRTY;
+  if (up && mgr.browse.bank + 1 < POD_BANK_COUNT) {
+    mgr.browse.bank++;
+  } else if (!up && mgr.browse.bank) {
+    mgr.browse.bank--;
+  } else {
+    // stays at the end
+    return;
+  }
+#ifdef VIRTUAL_HW
+  printf("VFBV: browse to bank %u at %u ms\n", mgr.browse.bank + 1, (uint32_t)TICK_get());
+#endif
+}
+
+// the chord switches only browsed on their way down, take that back
+static void _browse_restore(void) {
+  if (!mgr.browse.savedActive) {
+    _browse_end();
+    return;
+  }
+  mgr.browse.active = 1;
+  mgr.browse.bank = mgr.browse.savedBank;
+  mgr.flags |= FLAG_DISPLAY_DIRTY;
+  if (BROWSE_TIMEOUT) {
+    TIMER_start(&mgr.browse.idle, BROWSE_TIMEOUT, 0, _browse_idle);
+  }
+}
+
+// left alone, the bank shown loads with the channel playing
+static void _browse_idle(tick_t now) {
+  uint8_t bank = mgr.browse.bank;
+  (void)now;
+
+  _browse_end();
+  if (bank != mgr.actualProgram / 4) {
+    _pod_activate_program(4*bank + mgr.actualProgram % 4 + 1);
+  }
+  _housekeeping_in(0);
+}
+
+// a channel of the bank shown, or of the one playing
+static void _select_channel(uint8_t channel) {
+  uint8_t bank = mgr.browse.active ? mgr.browse.bank : mgr.actualProgram / 4;
+
+  _browse_end();
+  _pod_activate_program(4*bank + channel + 1);
+}
+
+// the tempo is estimated here, the POD only gets the result; at is when
+// the switch went down
+static void _tap_tempo(tick_t at) {
+  AUTOMATION_add(AUTOMATION_TAP, 0, at);
+  if (!TEMPO_tap(at)) {
+    return;
+  }
+  POD_set_tempo(TEMPO_get_bpm10());
+  LFO_set_tempo(TEMPO_get_bpm10());
+  if (MIDI_CLOCK_ENABLE) {
+    CLOCK_set_tempo(TEMPO_get_bpm10());
+    if (!CLOCK_is_running()) {
+      CLOCK_start();
+    }
+  }
+}
+
+// recorded actions played back
+static void _automation_action(uint8_t op, uint8_t value) {
+  _housekeeping_in(0);
+  switch (op) {
+  case AUTOMATION_PROGRAM:
+    _pod_activate_program(value);
+    break;
+  case AUTOMATION_FX_ON:
+  case AUTOMATION_FX_OFF:
+    _pod_fx_set_state(value, op == AUTOMATION_FX_ON, 1);
+    break;
+  case AUTOMATION_TAP:
+    _tap_tempo(TICK_get());
+    break;
+  default:
+    break;
+  }
 }
 
 static inline uint8_t _pod_fx_get_state(uint8_t fxId) {
@@ -224,251 +528,475 @@ static void _set_led_state(uint8_t ledId, uint8_t state) {
   }
 }
 
-// receive message from FBV
-static void _fbv_rx(FBVMessage msg) {
-  uint8_t temp = 0;
-  // if we receive anything, then POD is alive
+// any message from FBV means the POD is alive, and holds off the LEDs and
+// display until the rest of its burst is in
+static void _fbv_rx(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  (void)msg;
   mgr.flags |= FLAG_POD_ALIVE;
-  if (msg.msgType == FBV_PING) {
-    if (mgr.flags & FLAG_WAIT_POD) {
-      // done waiting
-      _fbv_msg(FBV_HNDSHAKE, 1, (uint8_t*)0x08);
+  if (!mgr.burst.open) {
+    mgr.burst.open = 1;
+    mgr.burst.first = TICK_get();
+    mgr.burst.last = mgr.burst.first;
+  }
+}
+
+// still in the middle of a burst
+static uint8_t _fbv_burst_open(tick_t now) {
+  if (mgr.burst.open && ((now - mgr.burst.last) >= FBV_BURST_QUIET ||
+                         (now - mgr.burst.first) >= FBV_BURST_MAX)) {
+    mgr.burst.open = 0;
+  }
+  return mgr.burst.open;
+}
+
+static void _fbv_rx_ping(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  (void)msg;
+  if (mgr.flags & FLAG_WAIT_POD) {
+    // done waiting; if the link is backed up, try again on next ping
+    if (_fbv_msg(FBV_HNDSHAKE, 1, (uint8_t*)0x08) == FBV_TX_OK) {
       mgr.flags &= ~FLAG_WAIT_POD;
-    } else {
+      // POD (re)started, it has no running status and we don't know its state
+      POD_reset_running_status();
+      POD_invalidate_shadow();
+    }
+  } else {
 #ifdef POD_RESPOND_PINGS
-      // respond to ping
-      _fbv_msg(FBV_ACK, 6, (uint8_t*)FBV_PINGBACK);
+    // respond to ping
+    _fbv_msg(FBV_ACK, 6, (uint8_t*)FBV_PINGBACK);
 #endif
-    }
+  }
+}
+
+// LEDs govern FX states
+static void _fbv_rx_led(FBVContext* ctx, const FBVMessageView* msg) {
+  uint8_t entry = 0;
+  (void)ctx;
+  if (msg->paramSize < 2 || msg->params[0] >= FBVMAP_LED_COUNT) {
     return;
   }
 
-  // receive and commit states
-  if (msg.msgType == FBV_SET_LED) {
-    // LEDs govern FX states
-    temp = _fbv_led_to_fx((FBVLED)(msg.params[0]));
-    if (temp != POD_INVALID_FX) {
-      if (_pod_fx_get_state(temp) != msg.params[1]) {
-        // only emit state changes if state is actually different
-        _pod_fx_set_state(temp, msg.params[1], 0);
-      }
+  entry = FBVMAP_LEDS[msg->params[0]];
+  if ((entry & FBVMAP_FX) && (mgr.predict.fx & (1<<FBVMAP_INDEX(entry)))) {
+    // confirms or corrects what the press showed
+#ifdef VIRTUAL_HW
+    printf("VFBV: FX %u prediction %s\n", FBVMAP_INDEX(entry),
+           _pod_fx_get_state(FBVMAP_INDEX(entry)) == msg->params[1] ? "confirmed" : "corrected");
+#endif
+    mgr.predict.fx &= ~(1<<FBVMAP_INDEX(entry));
+    _predict_done();
+  }
+  if (entry & FBVMAP_FX) {
+    // the POD reports its own state, no need to send it back
+    if (FBVMAP_INDEX(entry) < POD_FX_COUNT) {
+      POD_set_control_shadow((PODControlType)POD_FX_CONTROLS[FBVMAP_INDEX(entry)],
+                             msg->params[1] ? 0x7f : 0x00);
     }
-    else {
-      temp = _fbv_led_to_internal((FBVLED)(msg.params[0]));
-      if (temp != LED_INVALID) {
-        _set_led_state(temp, msg.params[1]);
-      }
+    if (_pod_fx_get_state(FBVMAP_INDEX(entry)) != msg->params[1]) {
+      // only emit state changes if state is actually different
+      _pod_fx_set_state(FBVMAP_INDEX(entry), msg->params[1], 0);
     }
+    _preset_touch();
+  } else if (entry & FBVMAP_CHANNEL) {
+    _set_led_state(FBVMAP_INDEX(entry), msg->params[1]);
+  }
 #ifdef VIRTUAL_HW
-    printf("VFBV: set LED 0x%hhx to %s\n", msg.params[0], msg.params[1] ? "ON": "OFF");
+  printf("VFBV: set LED 0x%hhx to %s\n", msg->params[0], msg->params[1] ? "ON": "OFF");
 #endif
+}
+
+// handle text
+static void _fbv_rx_text(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (msg->paramSize < 18) {
     return;
   }
-
-  // handle text
-  if (msg.msgType == FBV_SET_TXT) {
-    if (strncmp((const char*)(msg.params+2), mgr.currentText, 16)) {
-      memcpy(mgr.currentText, msg.params+2, 16);
-      mgr.flags |= FLAG_DISPLAY_DIRTY;
+  _preset_touch();
+  if (memcmp(msg->params+2, mgr.currentText, 16)) {
+    memcpy(mgr.currentText, msg->params+2, 16);
+    mgr.flags |= FLAG_DISPLAY_DIRTY;
 #ifdef VIRTUAL_HW
-      printf("VFBV: change text to '%s'\n", mgr.currentText);
+    printf("VFBV: change text to '%.16s'\n", mgr.currentText);
 #endif
-    }
-    return;
   }
+}
 
-  // handle program text: bank / channel
-  if (msg.msgType == FBV_SET_CH) {
-    if (msg.params[0] != mgr.currentProgram[2]) {
-      mgr.currentProgram[2] = msg.params[0];
-      mgr.flags |= FLAG_PGM_UPDATE_1;
+// handle program text: bank / channel
+static void _fbv_rx_channel(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (!msg->paramSize) {
+    return;
+  }
+  // the same as predicted still answers it
+  _program_touch();
+  if (msg->params[0] != mgr.currentProgram[2]) {
+    mgr.currentProgram[2] = msg->params[0];
+    mgr.flags |= FLAG_PGM_UPDATE_1;
 #ifdef VIRTUAL_HW
-      printf("VFBV: change channel to %c\n", mgr.currentProgram[2]);
+    printf("VFBV: change channel to %c\n", mgr.currentProgram[2]);
 #endif
-    }
-    return;
   }
+}
 
-  if (msg.msgType == FBV_SET_BNK1) {
-    if (msg.params[0] != mgr.currentProgram[0]) {
-      mgr.currentProgram[0] = msg.params[0];
-      mgr.flags |= FLAG_PGM_UPDATE_2;
+static void _fbv_rx_bank1(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (!msg->paramSize) {
+    return;
+  }
+  // the same as predicted still answers it
+  _program_touch();
+  if (msg->params[0] != mgr.currentProgram[0]) {
+    mgr.currentProgram[0] = msg->params[0];
+    mgr.flags |= FLAG_PGM_UPDATE_2;
 #ifdef VIRTUAL_HW
-      printf("VFBV: change prg digit 1 to '%c'\n", mgr.currentProgram[0]);
+    printf("VFBV: change prg digit 1 to '%c'\n", mgr.currentProgram[0]);
 #endif
-    }
+  }
+}
+
+static void _fbv_rx_bank2(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (!msg->paramSize) {
     return;
   }
+  // the same as predicted still answers it
+  _program_touch();
+  if (msg->params[0] != mgr.currentProgram[1]) {
+    mgr.currentProgram[1] = msg->params[0];
+    mgr.flags |= FLAG_PGM_UPDATE_3;
+#ifdef VIRTUAL_HW
+    printf("VFBV: change prg digit 2 to '%c'\n", mgr.currentProgram[1]);
+#endif
+  }
+}
 
-  if (msg.msgType == FBV_SET_BNK2) {
-    if (msg.params[0] != mgr.currentProgram[1]) {
-      mgr.currentProgram[1] = msg.params[0];
-      mgr.flags |= FLAG_PGM_UPDATE_3;
+// tuner note, only sent while the tuner is on
+static void _fbv_rx_tuner(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (msg->paramSize < 4) {
+    return;
+  }
+  mgr.tunerLastSeen = TICK_get();
+  if (!(mgr.flags & FLAG_TUNER_MODE) || msg->params[3] != mgr.tunerNote) {
+    mgr.flags |= FLAG_TUNER_MODE | FLAG_DISPLAY_DIRTY;
+    mgr.tunerNote = msg->params[3];
 #ifdef VIRTUAL_HW
-      printf("VFBV: change prg digit 2 to '%c'\n", mgr.currentProgram[1]);
+    printf("VFBV: tuner note '%c'\n", mgr.tunerNote);
 #endif
-    }
+  }
+}
+
+static void _fbv_rx_flat(FBVContext* ctx, const FBVMessageView* msg) {
+  (void)ctx;
+  if (!msg->paramSize) {
     return;
   }
+  if ((msg->params[0] ? 1 : 0) != mgr.tunerFlat) {
+    mgr.tunerFlat = msg->params[0] ? 1 : 0;
+    mgr.flags |= FLAG_DISPLAY_DIRTY;
+  }
 }
 
-static void _fbv_tx(uint8_t byte) {
+static uint32_t _pod_time(void) {
+  return (uint32_t)TICK_get();
+}
+
+// MIDI from the POD; libpod already folds it into its shadow
+static void _pod_rx_program(uint8_t channel, uint8_t program) {
 #ifdef VIRTUAL_HW
-  printf("FBV TX: %hhx\n", byte);
-  VIRTUAL_fbv_rxbyte(byte);
-#else
-  usart_send_blocking(USART1, byte);
+  printf("VMIDI: program change %u on channel %u\n", program, channel + 1);
 #endif
 }
 
-static void _pod_tx(uint8_t byte) {
+static void _pod_rx_sysex(const uint8_t* data, uint8_t size,
+                          uint16_t offset, uint8_t flags) {
+  PRESETS_sysex(data, size, offset, flags);
 #ifdef VIRTUAL_HW
-  printf("MIDI TX: %hhx\n", byte);
-  VIRTUAL_midi_rxbyte(byte);
-#else
-  usart_send_blocking(USART2, byte);
+  if (flags & POD_SYSEX_FIRST) {
+    printf("VMIDI: SysEx start\n");
+  }
+  if (flags & POD_SYSEX_LAST) {
+    printf("VMIDI: SysEx %s after %u bytes\n",
+           (flags & POD_SYSEX_ABORTED) ? "aborted" : "done", offset + size);
+  }
 #endif
 }
 
-#ifndef VIRTUAL_HW
 static void _lcd_redraw(void) {
   LCDContents display;
 
-  memcpy((void *)display[0], mgr.currentProgram, 3);
-  memset((void *)display[0] + 3, 0x20, LCD_COLS - 3);
+  if (mgr.flags & FLAG_TUNER_MODE) {
+    memset((void *)display[0], 0x20, LCD_COLS);
+    memcpy((void *)display[0], "TUNER", 5);
+    display[0][7] = mgr.tunerNote;
+    display[0][8] = mgr.tunerFlat ? 'b' : ' ';
+  } else if (mgr.browse.active) {
+    // banks count from 1 on the POD
+    memset((void *)display[0], 0x20, LCD_COLS);
+    memcpy((void *)display[0], "BANK", 4);
+    display[0][5] = mgr.browse.bank >= 9 ? '0' + (mgr.browse.bank + 1) / 10 : ' ';
+    display[0][6] = '0' + (mgr.browse.bank + 1) % 10;
+  } else {
+    memcpy((void *)display[0], mgr.currentProgram, 3);
+    memset((void *)display[0] + 3, 0x20, LCD_COLS - 3);
+  }
   memcpy((void *)display[1], mgr.currentText, LCD_COLS);
+#ifdef VIRTUAL_HW
+  VIRTUAL_lcd(&display);
+#else
   LCD_draw(&display);
-}
 #endif
+}
 
 void MANAGER_initialize(void) {
   PODStateMachineConfig podCfg;
   FBVStateMachineConfig fbvCfg;
+  uint8_t i = 0;
 
   // setup
-  fbvCfg.msgRx = _fbv_rx; //_queue_in;
-  fbvCfg.msgTx = _fbv_tx;
-  podCfg.msgTx = _pod_tx;
+  fbvCfg.msgRx = NULL;
+  fbvCfg.msgRxCtx = _fbv_rx;
+  fbvCfg.user = NULL;
+  fbvCfg.msgTx = NULL;
+  fbvCfg.msgTxBulk = SERIAL_fbv_send;
+  podCfg.msgTx = NULL;
+  podCfg.msgTxBulk = SERIAL_midi_send;
   podCfg.channel = POD_MIDI_CHANNEL - 1;
+  podCfg.statusRefresh = POD_STATUS_REFRESH;
+  podCfg.ccBudget = POD_CC_BUDGET;
+  podCfg.msgTxPending = SERIAL_midi_tx_pending;
+  podCfg.getTime = _pod_time;
+  podCfg.msgRxControl = NULL;
+  podCfg.msgRxProgram = _pod_rx_program;
+  podCfg.msgRxRealtime = NULL;
+  podCfg.msgRxSysex = _pod_rx_sysex;
+  podCfg.msgTxRealtime = SERIAL_midi_thru;
 
   // initialize
   FBV_initialize(&fbvCfg);
   POD_initialize(&podCfg);
-  mgr.mainCycleTimer = 0;
+  TEMPO_initialize();
+  PRESETS_initialize();
+  LFO_initialize();
+  AUTOMATION_initialize(_automation_action);
+  GESTURE_initialize(GESTURE_CONFIGS, MANAGER_btn_event);
+  for (i = 0; i < LFO_COUNT; i++) {
+    LFO_configure(i, &LFO_CONFIGS[i]);
+  }
+
+  // command dispatch
+  FBV_register(FBV_PING, _fbv_rx_ping);
+  FBV_register(FBV_SET_LED, _fbv_rx_led);
+  FBV_register(FBV_SET_TXT, _fbv_rx_text);
+  FBV_register(FBV_SET_CH, _fbv_rx_channel);
+  FBV_register(FBV_SET_BNK1, _fbv_rx_bank1);
+  FBV_register(FBV_SET_BNK2, _fbv_rx_bank2);
+  FBV_register(FBV_TUN_STAT, _fbv_rx_tuner);
+  FBV_register(FBV_SET_FLAT, _fbv_rx_flat);
+
   mgr.fxState = 0;
   mgr.otherLedState = 0;
-  mgr.btnStates = 0;
   mgr.expValues = 0;
-  mgr.msgQueueRd = 0;
-  mgr.msgQueueWr = 0;
+  memset(&mgr.pending, 0, sizeof(FBVPending));
+  mgr.tunerNote = ' ';
+  mgr.tunerFlat = 0;
+  mgr.tunerLastSeen = 0;
+  mgr.presetSeen = 0;
+  mgr.tapPending = 0;
   memcpy(mgr.currentText, INITIAL_TEXT[1], 16);
   memset(mgr.currentProgram, 0x20, 3);
-  memset(mgr.btnHoldCount, 0, IO_LED_COUNT);
   mgr.flags = FLAG_WAIT_POD|FLAG_FIRST_PING;
-  #ifndef VIRTUAL_HW
+  TIMER_start(&mgr.probe, 0, PROBE_INTERVAL, _probe_pod);
+  mgr.ledsShown = 0;
+  LEDS_set_state(0);
   _lcd_redraw();
-  #endif
 }
 
-static inline void _refresh_leds(void) {
+static inline void _refresh_leds(tick_t now) {
   uint32_t led_states = 0;
 
   led_states |= mgr.otherLedState;
   led_states |= ((uint32_t)(mgr.fxState) << LED_COUNT);
-  LEDS_set_state(led_states);
+  led_states ^= ((uint32_t)TEMPO_beat(now) << LED_TAP);
+  if (led_states != mgr.ledsShown) {
+    mgr.ledsShown = led_states;
+    LEDS_set_state(led_states);
+  }
 }
 
+// also called for each repeat
 static void _btn_hold_evt(uint8_t btn) {
   switch (btn) {
   case BTN_TAP:
+    // held for the tuner, not a tap
+    mgr.tapPending = 0;
     if (!(mgr.flags & FLAG_TUNER_MODE)) {
       POD_enable_tuner();
+      // nothing to play along to while tuning
+      CLOCK_stop();
+    }
+    break;
+  case BTN_UP:
+  case BTN_DN:
+    if ((OUTPUT_MODE & OUTPUT_MIDI) && !(mgr.flags & FLAG_TUNER_MODE)) {
+      _browse_step(btn == BTN_UP);
     }
     break;
   }
 }
 
-static void _detect_btn_hold(void) {
-  static uint32_t btn_states = 0;
-  static uint32_t holding = 0;
-  uint8_t i = 0;
+static void _btn_chord_evt(uint8_t first, uint8_t second) {
+  if ((first != AUTOMATION_CHORD_A || second != AUTOMATION_CHORD_B) &&
+      (first != AUTOMATION_CHORD_B || second != AUTOMATION_CHORD_A)) {
+    return;
+  }
+  _browse_restore();
+  switch (AUTOMATION_get_state()) {
+  case AUTOMATION_IDLE:
+    AUTOMATION_record(TICK_get());
+    break;
+  case AUTOMATION_RECORDING:
+    // ends the recording
+    AUTOMATION_play();
+    break;
+  default:
+    AUTOMATION_stop();
+    break;
+  }
+}
 
-  for (i=0; i<IO_BTN_COUNT; i++) {
-    if ((btn_states & (1<<i)) ^ (mgr.btnStates & (1<<i))) {
-      // state changed
-      if (mgr.btnStates & (1<<i)) {
-        if (mgr.btnHoldCount[i] < BTN_HOLD_THRESH) {
-          mgr.btnHoldCount[i]++;
-        } else {
-          if (!(holding & (1<<i))) {
-            // trigger hold event only once
-            _btn_hold_evt(i);
-            holding |= (1 << i);
-          }
-        }
-      } else {
-        // reset count
-        mgr.btnHoldCount[i] = 0;
-        holding &= ~(1<<i);
-      }
-    }
+// a pedal's value is kept once the FBV line took it, until then the
+// latest value is tried again on the next pass
+static inline uint8_t _report_exp(FBVControl fbv_ctl, PODControlType midi_ctl, uint8_t value) {
+  if ((OUTPUT_MODE & OUTPUT_FBV) && _fbv_report_control(fbv_ctl, value) != FBV_TX_OK) {
+    return 0;
+  }
+  if (OUTPUT_MODE & OUTPUT_MIDI) {
+    // queue latest values, POD_service sends them as the budget allows;
+    // a value queued again is dropped as unchanged
+    POD_queue_control(midi_ctl, value);
   }
-  // save last
-  btn_states = mgr.btnStates;
+  return 1;
 }
 
-static inline void _detect_exp_change(void) {
-  uint32_t exp_val = EXP_get_values();
-  if (exp_val != mgr.expValues) {
-    // emit MIDI message (will depend on configuration)
-    if ((exp_val & 0x00FF) ^ (mgr.expValues & 0x00FF)) {
-      // exp pedal 1 changed
-      POD_change_control(EXP1_CC, (uint8_t)(exp_val & 0xFF));
-    } else {
-      // exp pedal 2 changed
-      POD_change_control(EXP2_CC, (uint8_t)(exp_val>>8));
-    }
-    // update values
-    mgr.expValues = exp_val;
+// true while a value is left to report
+static inline uint8_t _detect_exp_change(void) {
+  uint16_t exp_val = EXP_get_values();
+
+  if ((exp_val & 0x00FF) != (mgr.expValues & 0x00FF) &&
+      _report_exp(FBV_CTL_PEDAL1, EXP1_CC, (uint8_t)(exp_val & 0xFF))) {
+    mgr.expValues = (mgr.expValues & 0xFF00) | (exp_val & 0x00FF);
+  }
+  if ((exp_val & 0xFF00) != (mgr.expValues & 0xFF00) &&
+      _report_exp(FBV_CTL_PEDAL2, EXP2_CC, (uint8_t)(exp_val >> 8))) {
+    mgr.expValues = (mgr.expValues & 0x00FF) | (exp_val & 0xFF00);
   }
+  return exp_val != mgr.expValues;
 }
 
+// an LFO runs while its effect is on
+static uint8_t _lfo_gate(uint8_t id) {
+  // a pedal on the same control would be overwritten on every update
+  return LFO_GATES[id] < POD_FX_COUNT && _pod_fx_get_state(LFO_GATES[id]) &&
+    LFO_CONFIGS[id].ctl != EXP1_CC && LFO_CONFIGS[id].ctl != EXP2_CC;
+}
 
-void MANAGER_cycle(void) {
-  static uint32_t lastPing = 0;
-  tick_t now = 0;
-  uint32_t tmp = 0;
-  FBVMessage msg;
+// LFOs start when their effect is turned on and stop with it
+static void _run_lfos(tick_t now) {
+  uint8_t i = 0;
+  uint8_t gate = 0;
+  uint8_t running = 0;
 
-  // throttle main cycle
-  now = TICK_get();
-  if ((now - mgr.mainCycleTimer) < MAIN_LOOP_INTERVAL) {
+  if (!(OUTPUT_MODE & OUTPUT_MIDI) || (mgr.flags & FLAG_WAIT_POD)) {
+    // housekeeping arms it again once the POD is back
+    TIMER_stop(&mgr.lfoUpdate);
     return;
   }
-
-  // process messages
-  while (_queue_out(&msg)) {
-    _fbv_rx(msg);
+  for (i = 0; i < LFO_COUNT; i++) {
+    gate = _lfo_gate(i);
+    if (gate && !LFO_is_running(i)) {
+      LFO_start(i, now);
+    } else if (!gate && LFO_is_running(i)) {
+      LFO_stop(i);
+    }
+    running |= gate;
+  }
+  if (!running) {
+    TIMER_stop(&mgr.lfoUpdate);
+    return;
   }
+  LFO_cycle(now);
+}
 
-  if (!(mgr.flags & FLAG_POD_ALIVE) || (mgr.flags & FLAG_FIRST_PING)) {
-    // we just booted and haven't established that the POD is present yet,
-    // so fire pings at it
-    if (!lastPing) {
-      _fbv_msg(FBV_PROBE, 1, (uint8_t*)0x00);
-      mgr.flags &= ~FLAG_FIRST_PING;
-      lastPing = PROBE_INTERVAL_MULT;
-    }
-    else {
-      lastPing--;
+// update the LFOs only while one of them is or should be running
+static void _arm_lfos(void) {
+  uint8_t i = 0;
+
+  if (TIMER_is_active(&mgr.lfoUpdate) || !(OUTPUT_MODE & OUTPUT_MIDI) ||
+      (mgr.flags & FLAG_WAIT_POD)) {
+    return;
+  }
+  for (i = 0; i < LFO_COUNT; i++) {
+    if (_lfo_gate(i) || LFO_is_running(i)) {
+      TIMER_start(&mgr.lfoUpdate, 0, LFO_UPDATE_INTERVAL, _run_lfos);
+      return;
     }
   }
-  else {
-    lastPing = 0;
+}
+
+// until it answers, so we know it's there
+static void _probe_pod(tick_t now) {
+  (void)now;
+  if ((mgr.flags & FLAG_POD_ALIVE) && !(mgr.flags & FLAG_FIRST_PING)) {
+    TIMER_stop(&mgr.probe);
+    return;
   }
+  if (_fbv_msg(FBV_PROBE, 1, (uint8_t*)0x00) == FBV_TX_OK) {
+    mgr.flags &= ~FLAG_FIRST_PING;
+  } else {
+    // line busy, try again on the next tick
+    TIMER_start(&mgr.probe, 1, PROBE_INTERVAL, _probe_pod);
+  }
+}
+
+// the earlier of two waits in ms, 0 being none
+static inline uint32_t _sooner(uint32_t next, uint32_t wait) {
+  return wait && (!next || wait < next) ? wait : next;
+}
 
-  // trigger program number update
-  if (mgr.flags & (FLAG_PGM_UPDATE_1|FLAG_PGM_UPDATE_2|FLAG_PGM_UPDATE_3)) {
+// ms until housekeeping has something time based to do, 0 for nothing
+static uint32_t _housekeeping_next(tick_t now, uint8_t burst, uint8_t exp) {
+  uint32_t next = 0;
+  uint32_t elapsed = 0;
+
+  if (burst) {
+    // the end of the burst
+    next = _sooner(FBV_BURST_QUIET - (uint32_t)(now - mgr.burst.last),
+                   FBV_BURST_MAX - (uint32_t)(now - mgr.burst.first));
+  }
+  if (mgr.presetSeen) {
+    // settled, or held off by a pending update: look again later
+    elapsed = (uint32_t)(now - mgr.presetSeen);
+    next = _sooner(next, elapsed > PRESET_SETTLE ? PRESET_SETTLE : PRESET_SETTLE + 1 - elapsed);
+  }
+  if (mgr.flags & FLAG_TUNER_MODE) {
+    next = _sooner(next, TUNER_TIMEOUT + 1 - (uint32_t)(now - mgr.tunerLastSeen));
+  }
+  if (exp) {
+    next = _sooner(next, EXP_RETRY_INTERVAL);
+  }
+  // the tempo LED
+  return _sooner(next, TEMPO_next_change(now));
+}
+
+static void _housekeeping(tick_t now) {
+  uint32_t tmp = 0;
+  uint8_t burst = _fbv_burst_open(now);
+  uint8_t exp = 0;
+
+  // trigger program number update, once all digits are in
+  if (!burst && (mgr.flags & (FLAG_PGM_UPDATE_1|FLAG_PGM_UPDATE_2|FLAG_PGM_UPDATE_3))) {
     // calculate actual program number
     tmp += (mgr.currentProgram[0] == 0x20 ? 0: 10*(mgr.currentProgram[0] - '0'));
     tmp += (mgr.currentProgram[1] - '1');
@@ -479,39 +1007,89 @@ void MANAGER_cycle(void) {
     if (!(mgr.flags & FLAG_WAIT_POD)) {
       mgr.flags &= ~(FLAG_PGM_UPDATE_1 | FLAG_PGM_UPDATE_2 | FLAG_PGM_UPDATE_3);
       mgr.flags |= FLAG_DISPLAY_DIRTY;
+      // PC 0 is manual mode, so bank 1 channel A is PC 1
+      POD_set_program_shadow(mgr.actualProgram + 1);
     }
   }
 
-  // refresh led states
-  _refresh_leds();
+  // remember what the current program looks like
+  if (mgr.presetSeen && (now - mgr.presetSeen) > PRESET_SETTLE &&
+      !(mgr.flags & (FLAG_WAIT_POD|FLAG_PGM_UPDATE_1|FLAG_PGM_UPDATE_2|FLAG_PGM_UPDATE_3))) {
+    mgr.presetSeen = 0;
+    _program_settled();
+    if (mgr.currentProgram[2] >= 'A' && mgr.currentProgram[2] <= 'D') {
+      PRESETS_store(mgr.actualProgram, mgr.currentText, mgr.fxState);
+    }
+  }
 
-  // manage button hold status
-  _detect_btn_hold();
+  // POD left tuner mode by itself
+  if ((mgr.flags & FLAG_TUNER_MODE) && (now - mgr.tunerLastSeen) > TUNER_TIMEOUT) {
+    mgr.flags &= ~FLAG_TUNER_MODE;
+    mgr.flags |= FLAG_DISPLAY_DIRTY;
+  }
 
   // manage expression pedal change
-  _detect_exp_change();
+  exp = _detect_exp_change();
+
+  // effects turned on or off since last time
+  _arm_lfos();
+
+  // LEDs and display change in one go at the end of a burst
+  if (!burst) {
+    // refresh led states
+    _refresh_leds(now);
 
-  // trigger display redraw
-  if ((mgr.flags & FLAG_DISPLAY_DIRTY) && !(mgr.flags & FLAG_WAIT_POD)) {
-    // redraw
-    #ifndef VIRTUAL_HW
-    _lcd_redraw();
-    #endif
-    mgr.flags &= ~FLAG_DISPLAY_DIRTY;
+    // trigger display redraw
+    if ((mgr.flags & FLAG_DISPLAY_DIRTY) && !(mgr.flags & FLAG_WAIT_POD)) {
+      // redraw
+      _lcd_redraw();
+      mgr.flags &= ~FLAG_DISPLAY_DIRTY;
+    }
   }
 
-  // update cycle timer
-  mgr.mainCycleTimer = now;
+  tmp = _housekeeping_next(now, burst, exp);
+  if (tmp) {
+    _housekeeping_in(tmp);
+  }
 }
 
-// handle button events
-void MANAGER_btn_event(uint8_t btn_id, uint8_t state) {
-  uint8_t pgm = 0;
-  // disable presses if starting
-  if (mgr.flags & FLAG_WAIT_POD) {
-    return;
+static void _pod_service(tick_t now) {
+  POD_service((uint32_t)now);
+}
+
+// on every pass of the main loop, the rest runs off timers
+void MANAGER_cycle(void) {
+  uint8_t rxChunk[RX_CHUNK_SIZE];
+  uint16_t rxCount = 0;
+
+  // parse whatever the USART1 interrupt received since last time
+  while ((rxCount = SERIAL_fbv_recv(rxChunk, RX_CHUNK_SIZE))) {
+    FBV_recv_bytes(rxChunk, rxCount);
+    // a burst lasts as long as bytes keep coming
+    mgr.burst.last = TICK_get();
+    _housekeeping_in(FBV_BURST_QUIET);
   }
+  // and what USART2 got on MIDI in
+  while ((rxCount = SERIAL_midi_recv(rxChunk, RX_CHUNK_SIZE))) {
+    if (MIDI_MERGE_ENABLE) {
+      POD_merge_bytes(rxChunk, rxCount);
+    } else {
+      POD_recv_bytes(rxChunk, rxCount);
+    }
+  }
+
+  // recorded events are due to the microsecond, not the loop interval
+  AUTOMATION_cycle();
+
+  // keep the MIDI line fed as it drains, and come back while it has more
+  POD_service((uint32_t)TICK_get());
+  if (POD_tx_pending() && !TIMER_is_active(&mgr.service)) {
+    TIMER_start(&mgr.service, POD_SERVICE_INTERVAL, 0, _pod_service);
+  }
+}
 
+// dispatch footswitch actions as MIDI messages
+static void _midi_btn_event(uint8_t btn_id, uint8_t state) {
   // if in tuner mode, any button disables tuner mode
   if (mgr.flags & FLAG_TUNER_MODE) {
     if (state) {
@@ -525,32 +1103,14 @@ void MANAGER_btn_event(uint8_t btn_id, uint8_t state) {
   if (state) {
     switch(btn_id) {
     case BTN_CHA:
-      pgm = 4*(mgr.actualProgram / 4) + 1;
-      _pod_activate_program(pgm);
-      break;
     case BTN_CHB:
-      pgm = 4*(mgr.actualProgram / 4) + 2;
-      _pod_activate_program(pgm);
-      break;
     case BTN_CHC:
-      pgm = 4*(mgr.actualProgram / 4) + 3;
-      _pod_activate_program(pgm);
-      break;
     case BTN_CHD:
-      pgm = 4*(mgr.actualProgram / 4) + 4;
-      _pod_activate_program(pgm);
+      _select_channel(btn_id - BTN_CHA);
       break;
     case BTN_UP:
-      if (pgm/4 < 15) {
-        pgm = mgr.actualProgram + 4;
-        _pod_activate_program(pgm);
-      }
-      break;
     case BTN_DN:
-      if (pgm/4 > 0) {
-        pgm = mgr.actualProgram - 4;
-        _pod_activate_program(pgm);
-      }
+      _browse_step(btn_id == BTN_UP);
       break;
     case BTN_EQ:
       _pod_fx_toggle_state(POD_FX_EQ, 1);
@@ -567,23 +1127,62 @@ void MANAGER_btn_event(uint8_t btn_id, uint8_t state) {
     case BTN_WAH:
       _pod_fx_toggle_state(POD_FX_WAH, 1);
       break;
-    default:
-      break;
-    }
-  } else {
-    switch(btn_id) {
     case BTN_TAP:
-      POD_send_tap();
+      mgr.tapPending = 1;
+      mgr.tapAt = TICK_get();
       break;
     default:
       break;
     }
+  } else if (btn_id == BTN_TAP && mgr.tapPending) {
+    mgr.tapPending = 0;
+    _tap_tempo(mgr.tapAt);
+  }
+}
+
+// handle footswitch gestures
+void MANAGER_btn_event(uint8_t btn_id, GestureType gesture, uint8_t other) {
+  uint8_t state = (gesture == GESTURE_PRESS);
+
+  // disable presses if starting
+  if (mgr.flags & FLAG_WAIT_POD) {
+    return;
   }
 
-  // update local states
-  if (state) {
-    mgr.btnStates |= (1<<btn_id);
-  } else {
-    mgr.btnStates &= ~(1<<btn_id);
+  switch (gesture) {
+  case GESTURE_PRESS:
+  case GESTURE_RELEASE:
+    if (btn_id == AUTOMATION_CHORD_A || btn_id == AUTOMATION_CHORD_B) {
+      if (state && !mgr.browse.chordDown++) {
+        mgr.browse.savedActive = mgr.browse.active;
+        mgr.browse.savedBank = mgr.browse.bank;
+      } else if (!state && mgr.browse.chordDown) {
+        mgr.browse.chordDown--;
+      }
+    }
+    // report the switch natively, the POD acts on it by itself
+    if (OUTPUT_MODE & OUTPUT_FBV) {
+      _fbv_report_switch(btn_id, state);
+    }
+    if (OUTPUT_MODE & OUTPUT_MIDI) {
+      _midi_btn_event(btn_id, state);
+    }
+    break;
+  case GESTURE_HOLD:
+  case GESTURE_REPEAT:
+    _btn_hold_evt(btn_id);
+    break;
+  case GESTURE_CHORD:
+    _btn_chord_evt(btn_id, other);
+    break;
+  default:
+    break;
   }
+  _housekeeping_in(0);
+}
+
+// pedals moved, housekeeping reports them
+void MANAGER_exp_event(uint16_t values) {
+  (void)values;
+  _housekeeping_in(0);
 }
@@ -2,9 +2,11 @@
 #define _MANAGER_H_INCLUDED_
 
 #include <stdint.h>
+#include "gesture.h"
 
 void MANAGER_initialize(void);
 void MANAGER_cycle(void);
-void MANAGER_btn_event(uint8_t btn_id, uint8_t state);
+void MANAGER_btn_event(uint8_t btn_id, GestureType gesture, uint8_t other);
+void MANAGER_exp_event(uint16_t values);
 
 #endif
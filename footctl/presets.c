@@ -0,0 +1,113 @@
+#include "presets.h"
+#include "pod.h"
+#include "store.h"
+#include <string.h>
+
+#define PRESET_VALID 0x01
+
+// the flash copy is only written once the cache stopped changing
+#define PRESETS_SAVE_DELAY 10000
+#define PRESETS_MAGIC 0x5053
+
+// Line 6 patch dump: id, POD xt device, dump command, program, name,
+// FX states as two 7 bit bytes; parameter data after that is skipped
+#define DUMP_HEADER_SIZE 5
+#define DUMP_PROGRAM 5
+#define DUMP_NAME 6
+#define DUMP_FX (DUMP_NAME + PRESETS_NAME_SIZE)
+#define DUMP_END (DUMP_FX + 2)
+
+static const uint8_t DUMP_HEADER[DUMP_HEADER_SIZE] = {0x00, 0x01, 0x0C, 0x03, 0x71};
+
+typedef struct preset_s {
+  char name[PRESETS_NAME_SIZE];
+  uint8_t fxState;
+  uint8_t flags;
+} Preset;
+
+typedef struct presets_s {
+  Preset entries[PRESETS_COUNT];
+  // dump being decoded
+  Preset dump;
+  uint8_t dumpProgram;
+  uint8_t dumpValid;
+} Presets;
+
+static Presets presets;
+
+void PRESETS_initialize(void) {
+  memset(&presets, 0, sizeof(Presets));
+#ifdef PRESETS_FLASH
+  STORE_configure(STORE_PRESETS, PRESETS_FLASH_ADDR, PRESETS_FLASH_SIZE, PRESETS_MAGIC);
+  if (STORE_load(STORE_PRESETS, presets.entries, sizeof(presets.entries)) !=
+      sizeof(presets.entries)) {
+    // never saved, or by a build with another layout
+    memset(presets.entries, 0, sizeof(presets.entries));
+  }
+#endif
+}
+
+// 1 and the cached name and FX states if the program was seen before
+uint8_t PRESETS_lookup(uint8_t program, char* name, uint8_t* fxState) {
+  if (program >= PRESETS_COUNT || !(presets.entries[program].flags & PRESET_VALID)) {
+    return 0;
+  }
+  memcpy(name, presets.entries[program].name, PRESETS_NAME_SIZE);
+  *fxState = presets.entries[program].fxState;
+  return 1;
+}
+
+void PRESETS_store(uint8_t program, const char* name, uint8_t fxState) {
+  Preset* entry = NULL;
+
+  if (program >= PRESETS_COUNT) {
+    return;
+  }
+  entry = &presets.entries[program];
+  if ((entry->flags & PRESET_VALID) && entry->fxState == fxState &&
+      !memcmp(entry->name, name, PRESETS_NAME_SIZE)) {
+    return;
+  }
+  memcpy(entry->name, name, PRESETS_NAME_SIZE);
+  entry->fxState = fxState;
+  entry->flags = PRESET_VALID;
+#ifdef PRESETS_FLASH
+  // restarted on each change
+  STORE_save(STORE_PRESETS, presets.entries, sizeof(presets.entries), PRESETS_SAVE_DELAY);
+#endif
+}
+
+// warm the cache from patch dumps as they stream in
+void PRESETS_sysex(const uint8_t* data, uint8_t size, uint16_t offset, uint8_t flags) {
+  uint16_t pos = 0;
+  uint8_t i = 0;
+
+  if (flags & POD_SYSEX_FIRST) {
+    presets.dumpValid = 1;
+    presets.dump.fxState = 0;
+  }
+  for (i = 0; i < size && presets.dumpValid; i++) {
+    pos = offset + i;
+    if (pos < DUMP_HEADER_SIZE) {
+      presets.dumpValid = (data[i] == DUMP_HEADER[pos]);
+    } else if (pos == DUMP_PROGRAM) {
+      // PC numbering, 0 is manual mode
+      presets.dumpProgram = data[i];
+      presets.dumpValid = (data[i] > 0 && data[i] <= PRESETS_COUNT);
+    } else if (pos < DUMP_FX) {
+      presets.dump.name[pos - DUMP_NAME] = data[i];
+    } else if (pos == DUMP_FX) {
+      presets.dump.fxState = data[i];
+    } else if (pos == DUMP_FX + 1) {
+      presets.dump.fxState |= data[i] << 7;
+    } else {
+      // parameter data
+      break;
+    }
+  }
+
+  if ((flags & POD_SYSEX_LAST) && !(flags & POD_SYSEX_ABORTED) &&
+      presets.dumpValid && offset + size >= DUMP_END) {
+    PRESETS_store(presets.dumpProgram - 1, presets.dump.name, presets.dump.fxState);
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef _PRESETS_H_INCLUDED_
+#define _PRESETS_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+#define PRESETS_NAME_SIZE 16
+
+void PRESETS_initialize(void);
+uint8_t PRESETS_lookup(uint8_t program, char* name, uint8_t* fxState);
+void PRESETS_store(uint8_t program, const char* name, uint8_t fxState);
+void PRESETS_sysex(const uint8_t* data, uint8_t size, uint16_t offset, uint8_t flags);
+
+#endif
@@ -0,0 +1,90 @@
+#include "ring.h"
+
+// keep the compiler from moving buffer accesses across index updates
+#define RING_BARRIER() __asm__ volatile ("" ::: "memory")
+
+void RING_initialize(ByteRing* ring, uint8_t* buffer, uint16_t size) {
+  ring->buffer = buffer;
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->peak = 0;
+  ring->overflows = 0;
+}
+
+uint16_t RING_count(ByteRing* ring) {
+  return (uint16_t)(ring->head - ring->tail);
+}
+
+uint16_t RING_free(ByteRing* ring) {
+  return (ring->mask + 1) - RING_count(ring);
+}
+
+// producer side
+uint8_t RING_put(ByteRing* ring, uint8_t byte) {
+  uint16_t head = ring->head;
+  uint16_t count = head - ring->tail;
+  if (count > ring->mask) {
+    // full
+    ring->overflows++;
+    return 0;
+  }
+  ring->buffer[head & ring->mask] = byte;
+  RING_BARRIER();
+  ring->head = head + 1;
+  if (count >= ring->peak) {
+    ring->peak = count + 1;
+  }
+  return 1;
+}
+
+// consumer side
+uint8_t RING_get(ByteRing* ring, uint8_t* byte) {
+  uint16_t tail = ring->tail;
+  if (tail == ring->head) {
+    // empty
+    return 0;
+  }
+  *byte = ring->buffer[tail & ring->mask];
+  RING_BARRIER();
+  ring->tail = tail + 1;
+  return 1;
+}
+
+// producer side, all or nothing
+uint8_t RING_write(ByteRing* ring, const uint8_t* bytes, uint16_t size) {
+  uint16_t head = ring->head;
+  uint16_t count = 0;
+  if (RING_free(ring) < size) {
+    ring->overflows++;
+    return 0;
+  }
+  while (size--) {
+    ring->buffer[head & ring->mask] = *bytes++;
+    head++;
+  }
+  RING_BARRIER();
+  ring->head = head;
+  count = RING_count(ring);
+  if (count > ring->peak) {
+    ring->peak = count;
+  }
+  return 1;
+}
+
+// consumer side, returns amount of bytes read
+uint16_t RING_read(ByteRing* ring, uint8_t* bytes, uint16_t size) {
+  uint16_t tail = ring->tail;
+  uint16_t count = (uint16_t)(ring->head - tail);
+  uint16_t i = 0;
+  if (size > count) {
+    size = count;
+  }
+  for (i=0; i<size; i++) {
+    bytes[i] = ring->buffer[tail & ring->mask];
+    tail++;
+  }
+  RING_BARRIER();
+  ring->tail = tail;
+  return size;
+}
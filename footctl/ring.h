@@ -0,0 +1,27 @@
+#ifndef _RING_H_INCLUDED_
+#define _RING_H_INCLUDED_
+
+#include <stdint.h>
+
+// single producer / single consumer byte ring
+// size must be a power of 2; head is only written by the producer and
+// tail only by the consumer, so one side may run in interrupt context.
+// peak and overflows are maintained by the producer
+typedef struct byte_ring_s {
+  uint8_t* buffer;
+  uint16_t mask;
+  volatile uint16_t head;
+  volatile uint16_t tail;
+  volatile uint16_t peak;
+  volatile uint32_t overflows;
+} ByteRing;
+
+void RING_initialize(ByteRing* ring, uint8_t* buffer, uint16_t size);
+uint16_t RING_count(ByteRing* ring);
+uint16_t RING_free(ByteRing* ring);
+uint8_t RING_put(ByteRing* ring, uint8_t byte);
+uint8_t RING_get(ByteRing* ring, uint8_t* byte);
+uint8_t RING_write(ByteRing* ring, const uint8_t* bytes, uint16_t size);
+uint16_t RING_read(ByteRing* ring, uint8_t* bytes, uint16_t size);
+
+#endif
@@ -0,0 +1,134 @@
+#include "sched.h"
+#include "tick.h"
+#include "timer.h"
+#include <string.h>
+#ifdef VIRTUAL_HW
+#include <stdio.h>
+#include <time.h>
+#include "clock.h"
+#include "serial.h"
+#else
+#include <libopencm3/cm3/cortex.h>
+#endif
+
+#ifdef VIRTUAL_HW
+// how often the emulation prints its load
+#define SCHED_REPORT_INTERVAL 5000000ULL
+#endif
+
+typedef struct sched_s {
+  volatile uint8_t events;
+  uint64_t lastWake;
+  SchedStats stats;
+#ifdef VIRTUAL_HW
+  SchedStats reported;
+  uint64_t lastReport;
+#endif
+} Scheduler;
+
+static Scheduler sched;
+
+void SCHED_initialize(void) {
+  memset(&sched, 0, sizeof(Scheduler));
+  sched.lastWake = TICK_get_us();
+#ifdef VIRTUAL_HW
+  sched.lastReport = sched.lastWake;
+#endif
+}
+
+// called from interrupts
+void SCHED_post(uint8_t events) {
+  sched.events |= events;
+}
+
+#ifdef VIRTUAL_HW
+static void _report(uint64_t now) {
+  uint64_t busy = sched.stats.busy - sched.reported.busy;
+  uint64_t asleep = sched.stats.asleep - sched.reported.asleep;
+
+  if (now - sched.lastReport < SCHED_REPORT_INTERVAL || !(busy + asleep)) {
+    return;
+  }
+  printf("VSCHED: cpu %u.%u%%, %u wakeups/s\n",
+         (uint32_t)(busy * 100 / (busy + asleep)),
+         (uint32_t)(busy * 1000 / (busy + asleep) % 10),
+         (uint32_t)((sched.stats.wakeups - sched.reported.wakeups) * 1000000ULL /
+                    (now - sched.lastReport)));
+  sched.reported = sched.stats;
+  sched.lastReport = now;
+}
+
+// nothing interrupts the emulation: sleep until the next software timer
+// or clock timer event, ms by ms while the emulated lines are busy
+static void _sleep(uint64_t now) {
+  uint64_t deadline = (now / 1000 + 1) * 1000;
+  uint64_t timer = TIMER_next_deadline() * 1000;
+  uint64_t clock = CLOCK_next_event();
+  struct timespec delay;
+
+  if (!SERIAL_busy() && timer > deadline) {
+    deadline = timer;
+  }
+  if (clock && clock < deadline) {
+    deadline = clock;
+  }
+  if (deadline <= now) {
+    return;
+  }
+  delay.tv_sec = (deadline - now) / 1000000;
+  delay.tv_nsec = (long)((deadline - now) % 1000000) * 1000;
+  nanosleep(&delay, NULL);
+}
+#endif
+
+// sleep until an interrupt posts an event, unless one did since the last
+// call; returns the events posted meanwhile
+uint8_t SCHED_wait(void) {
+  uint64_t now = TICK_get_us();
+  uint8_t events = 0;
+  tick_t deadline = TIMER_next_deadline();
+
+  sched.stats.busy += now - sched.lastWake;
+#ifdef VIRTUAL_HW
+  _report(now);
+  // the emulated interrupts run while it sleeps, like on hardware
+  while (!sched.events && (!deadline || TICK_get() < deadline)) {
+    _sleep(TICK_get_us());
+    CLOCK_cycle();
+    SERIAL_cycle();
+  }
+#else
+  // an interrupt between the check and the wfi still wakes it up, as
+  // pending interrupts end wfi even while masked. SysTick and the clock
+  // interrupt come and go, only a posted event ends the sleep
+  cm_disable_interrupts();
+  TICK_set_wakeup(deadline);
+  while (!sched.events && (!deadline || TICK_get() < deadline)) {
+    __asm__ volatile ("wfi");
+    // the interrupt that woke us up runs here
+    cm_enable_interrupts();
+    cm_disable_interrupts();
+  }
+  TICK_set_wakeup(0);
+  cm_enable_interrupts();
+#endif
+  sched.lastWake = TICK_get_us();
+  sched.stats.asleep += sched.lastWake - now;
+  sched.stats.wakeups++;
+
+#ifndef VIRTUAL_HW
+  cm_disable_interrupts();
+#endif
+  events = sched.events;
+  sched.events = 0;
+#ifndef VIRTUAL_HW
+  cm_enable_interrupts();
+#endif
+  return events;
+}
+
+void SCHED_get_stats(SchedStats* stats) {
+  if (stats) {
+    *stats = sched.stats;
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef _SCHED_H_INCLUDED_
+#define _SCHED_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// events posted by interrupts; any of them ends the main loop's sleep.
+// TICK is the next software timer deadline
+#define SCHED_EVENT_TICK 0x01
+#define SCHED_EVENT_FBV_RX 0x02
+#define SCHED_EVENT_MIDI_RX 0x04
+#define SCHED_EVENT_TIMER 0x08
+
+// busy and asleep are in us since SCHED_initialize
+typedef struct sched_stats_s {
+  uint32_t wakeups;
+  uint64_t busy;
+  uint64_t asleep;
+} SchedStats;
+
+void SCHED_initialize(void);
+void SCHED_post(uint8_t events);
+uint8_t SCHED_wait(void);
+void SCHED_get_stats(SchedStats* stats);
+
+#endif
@@ -0,0 +1,351 @@
+#include "serial.h"
+#include "config.h"
+#include "ring.h"
+#include "tick.h"
+#include "sched.h"
+#ifdef VIRTUAL_HW
+#include <stdio.h>
+#include "virtual.h"
+#else
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/usart.h>
+#endif
+
+#ifdef STM32_MOCK
+#define USART_STATUS_REG USART_SR
+#define USART_RX_ISR USART_SR_RXNE
+#define USART_TX_ISR USART_SR_TXE
+#define USART_ORE_ISR USART_SR_ORE
+// cleared by the status read followed by the data read
+#define USART_CLEAR_ORE(USART)
+#else
+#define USART_STATUS_REG USART_ISR
+#define USART_RX_ISR USART_ISR_RXNE
+#define USART_TX_ISR USART_ISR_TXE
+#define USART_ORE_ISR USART_ISR_ORE
+#define USART_CLEAR_ORE(USART) USART_ICR(USART) = USART_ICR_ORECF
+#endif
+
+#ifdef VIRTUAL_HW
+// 31250 baud, 8N1: bytes per second on the wire
+#define SERIAL_LINE_RATE 3125
+#endif
+
+static uint8_t fbvTxBuffer[SERIAL_FBV_TX_SIZE];
+static uint8_t fbvRxBuffer[SERIAL_FBV_RX_SIZE];
+static uint8_t midiTxBuffer[SERIAL_MIDI_TX_SIZE];
+static uint8_t midiRtBuffer[SERIAL_MIDI_RT_SIZE];
+static uint8_t midiThruBuffer[SERIAL_MIDI_RT_SIZE];
+static uint8_t midiRxBuffer[SERIAL_MIDI_RX_SIZE];
+static ByteRing fbvTx;
+static ByteRing fbvRx;
+static ByteRing midiTx;
+// filled from the clock timer interrupt only
+static ByteRing midiRt;
+// realtime bytes merged from MIDI in, filled from the main loop only
+static ByteRing midiThru;
+static ByteRing midiRx;
+
+// MIDI counters; sent and busyTime are written by the TX interrupt
+static uint32_t midiQueued;
+static volatile uint32_t midiSent;
+static volatile uint32_t midiBusyTime;
+static volatile uint8_t midiBusy;
+static tick_t midiBusyStart;
+// low bits of the time a byte last came in on either line
+static volatile uint32_t lastRx;
+
+#ifdef VIRTUAL_HW
+typedef struct serial_line_s {
+  tick_t lastCycle;
+  uint32_t credit;
+} SerialLine;
+
+static SerialLine fbvLine;
+static SerialLine midiLine;
+
+// what the virtual POD sends back over MIDI, delivered at line rate
+#define SERIAL_MIDI_IN_LINE_SIZE 256
+static uint8_t midiInBuffer[SERIAL_MIDI_IN_LINE_SIZE];
+static ByteRing midiIn;
+static SerialLine midiInLine;
+
+// and over FBV
+#define SERIAL_FBV_IN_LINE_SIZE 256
+static uint8_t fbvInBuffer[SERIAL_FBV_IN_LINE_SIZE];
+static ByteRing fbvIn;
+static SerialLine fbvInLine;
+#endif
+
+void SERIAL_initialize(void) {
+  RING_initialize(&fbvTx, fbvTxBuffer, SERIAL_FBV_TX_SIZE);
+  RING_initialize(&fbvRx, fbvRxBuffer, SERIAL_FBV_RX_SIZE);
+  RING_initialize(&midiTx, midiTxBuffer, SERIAL_MIDI_TX_SIZE);
+  RING_initialize(&midiRt, midiRtBuffer, SERIAL_MIDI_RT_SIZE);
+  RING_initialize(&midiThru, midiThruBuffer, SERIAL_MIDI_RT_SIZE);
+  RING_initialize(&midiRx, midiRxBuffer, SERIAL_MIDI_RX_SIZE);
+  midiQueued = 0;
+  midiSent = 0;
+  midiBusyTime = 0;
+  midiBusy = 0;
+#ifdef VIRTUAL_HW
+  fbvLine.lastCycle = TICK_get();
+  fbvLine.credit = 0;
+  midiLine = fbvLine;
+  midiInLine = fbvLine;
+  RING_initialize(&midiIn, midiInBuffer, SERIAL_MIDI_IN_LINE_SIZE);
+  fbvInLine = fbvLine;
+  RING_initialize(&fbvIn, fbvInBuffer, SERIAL_FBV_IN_LINE_SIZE);
+#else
+  // not before the rings the interrupts fill are set up
+  USART_CR1(USART1) |= USART_CR1_RXNEIE;
+#ifdef GPIODEF_MIDI_RX_PORT
+  USART_CR1(USART2) |= USART_CR1_RXNEIE;
+#endif
+  nvic_enable_irq(NVIC_USART1_IRQ);
+  nvic_enable_irq(NVIC_USART2_IRQ);
+#endif
+}
+
+// queue a whole frame for transmission; never blocks
+FBVTxResult SERIAL_fbv_send(const uint8_t* bytes, uint8_t size) {
+  if (!RING_write(&fbvTx, bytes, size)) {
+    return FBV_TX_FULL;
+  }
+#ifndef VIRTUAL_HW
+  // TX interrupt drains the ring
+  USART_CR1(USART1) |= USART_CR1_TXEIE;
+#endif
+  return FBV_TX_OK;
+}
+
+uint16_t SERIAL_fbv_tx_pending(void) {
+  return RING_count(&fbvTx);
+}
+
+// fetch bytes received from the FBV link
+uint16_t SERIAL_fbv_recv(uint8_t* bytes, uint16_t size) {
+  return RING_read(&fbvRx, bytes, size);
+}
+
+void SERIAL_fbv_rx_stats(SerialRingStats* stats) {
+  if (!stats) {
+    return;
+  }
+  stats->pending = RING_count(&fbvRx);
+  stats->peak = fbvRx.peak;
+  stats->overflows = fbvRx.overflows;
+}
+
+// queue a whole MIDI message; never blocks
+PODTxResult SERIAL_midi_send(const uint8_t* bytes, uint8_t size) {
+  if (!RING_write(&midiTx, bytes, size)) {
+    return POD_TX_FULL;
+  }
+  midiQueued += size;
+  if (!midiBusy) {
+    // line was idle; the interrupt closes the busy period when it runs dry
+    midiBusyStart = TICK_get();
+    midiBusy = 1;
+  }
+#ifndef VIRTUAL_HW
+  USART_CR1(USART2) |= USART_CR1_TXEIE;
+#endif
+  return POD_TX_OK;
+}
+
+uint16_t SERIAL_midi_tx_pending(void) {
+  return RING_count(&midiTx);
+}
+
+// fetch bytes received on MIDI in
+uint16_t SERIAL_midi_recv(uint8_t* bytes, uint16_t size) {
+  return RING_read(&midiRx, bytes, size);
+}
+
+// nothing received for ms and nothing left to send or parse, so the core
+// may stall for a while without losing bytes
+uint8_t SERIAL_quiet(uint32_t ms) {
+  return !RING_count(&fbvTx) && !RING_count(&fbvRx) && !RING_count(&midiTx) &&
+    !RING_count(&midiRt) && !RING_count(&midiThru) && !RING_count(&midiRx) &&
+    (uint32_t)TICK_get() - lastRx >= ms;
+}
+
+void SERIAL_midi_rx_stats(SerialRingStats* stats) {
+  if (!stats) {
+    return;
+  }
+  stats->pending = RING_count(&midiRx);
+  stats->peak = midiRx.peak;
+  stats->overflows = midiRx.overflows;
+}
+
+// realtime byte, sent ahead of anything queued: at most the byte being
+// shifted out delays it
+void SERIAL_midi_realtime(uint8_t byte) {
+#ifdef VIRTUAL_HW
+  // the emulated line has no byte in flight; clock pulses are too
+  // frequent to log
+  if (byte != 0xF8) {
+    printf("MIDI TX: %hhx\n", byte);
+  }
+  midiSent++;
+  VIRTUAL_midi_rxbyte(byte);
+#else
+  RING_put(&midiRt, byte);
+  USART_CR1(USART2) |= USART_CR1_TXEIE;
+#endif
+}
+
+// realtime byte forwarded from MIDI in; a ring of its own keeps both
+// realtime rings single producer
+void SERIAL_midi_thru(uint8_t byte) {
+#ifdef VIRTUAL_HW
+  SERIAL_midi_realtime(byte);
+#else
+  RING_put(&midiThru, byte);
+  USART_CR1(USART2) |= USART_CR1_TXEIE;
+#endif
+}
+
+void SERIAL_midi_tx_stats(SerialTxStats* stats) {
+  if (!stats) {
+    return;
+  }
+  stats->queued = midiQueued;
+  stats->sent = midiSent;
+  stats->pending = RING_count(&midiTx);
+  stats->peak = midiTx.peak;
+  stats->overflows = midiTx.overflows;
+  stats->busyTime = midiBusyTime;
+}
+
+// the MIDI ring ran dry
+static void _midi_idle(void) {
+  if (midiBusy) {
+    midiBusyTime += (uint32_t)(TICK_get() - midiBusyStart);
+    midiBusy = 0;
+  }
+}
+
+#ifdef VIRTUAL_HW
+// emulate the TX interrupt draining the ring at line rate
+static void _line_drain(SerialLine* line, ByteRing* ring, tick_t now,
+                        void (*sink)(uint8_t)) {
+  uint8_t byte = 0;
+  line->credit += (uint32_t)(now - line->lastCycle) * SERIAL_LINE_RATE;
+  line->lastCycle = now;
+  while (line->credit >= 1000 && RING_get(ring, &byte)) {
+    line->credit -= 1000;
+    sink(byte);
+  }
+  if (!RING_count(ring)) {
+    // line is idle
+    line->credit = 0;
+  }
+}
+
+static void _fbv_line_out(uint8_t byte) {
+  printf("FBV TX: %hhx\n", byte);
+  VIRTUAL_fbv_rxbyte(byte);
+}
+
+// emulate the RX interrupt
+static void _fbv_line_in(uint8_t byte) {
+  lastRx = (uint32_t)TICK_get();
+  RING_put(&fbvRx, byte);
+  SCHED_post(SCHED_EVENT_FBV_RX);
+}
+
+void SERIAL_fbv_inject(uint8_t byte) {
+  RING_put(&fbvIn, byte);
+}
+
+static void _midi_line_out(uint8_t byte) {
+  printf("MIDI TX: %hhx\n", byte);
+  midiSent++;
+  VIRTUAL_midi_rxbyte(byte);
+}
+
+static void _midi_line_in(uint8_t byte) {
+  lastRx = (uint32_t)TICK_get();
+  RING_put(&midiRx, byte);
+  SCHED_post(SCHED_EVENT_MIDI_RX);
+}
+
+void SERIAL_midi_inject(uint8_t byte) {
+  RING_put(&midiIn, byte);
+}
+
+// the emulated lines need a pass of the loop every ms while bytes are
+// on their way
+uint8_t SERIAL_busy(void) {
+  return RING_count(&fbvTx) || RING_count(&fbvIn) || RING_count(&midiTx) ||
+    RING_count(&midiIn);
+}
+
+void SERIAL_cycle(void) {
+  tick_t now = TICK_get();
+  _line_drain(&fbvLine, &fbvTx, now, _fbv_line_out);
+  _line_drain(&midiLine, &midiTx, now, _midi_line_out);
+  _line_drain(&midiInLine, &midiIn, now, _midi_line_in);
+  _line_drain(&fbvInLine, &fbvIn, now, _fbv_line_in);
+  if (midiBusy && !RING_count(&midiTx)) {
+    _midi_idle();
+  }
+}
+#else
+void usart1_isr(void) {
+  uint8_t data = 0;
+  // a byte was lost in hardware before we could read it
+  if ((USART_STATUS_REG(USART1) & USART_ORE_ISR) != 0) {
+    USART_CLEAR_ORE(USART1);
+    FBV_line_overrun();
+  }
+  /* Check if we were called because of RXNE. */
+  if (((USART_CR1(USART1) & USART_CR1_RXNEIE) != 0) &&
+      ((USART_STATUS_REG(USART1) & USART_RX_ISR) != 0)) {
+
+    // parsing happens in the main loop; overflows are counted by the ring
+    data = usart_recv(USART1);
+    lastRx = (uint32_t)TICK_get();
+    RING_put(&fbvRx, data);
+    SCHED_post(SCHED_EVENT_FBV_RX);
+  }
+  if (((USART_CR1(USART1) & USART_CR1_TXEIE) != 0) &&
+      ((USART_STATUS_REG(USART1) & USART_TX_ISR) != 0)) {
+    if (RING_get(&fbvTx, &data)) {
+      usart_send(USART1, data);
+    } else {
+      // nothing left to send
+      USART_CR1(USART1) &= ~USART_CR1_TXEIE;
+    }
+  }
+}
+
+void usart2_isr(void) {
+  uint8_t data = 0;
+  // nothing to report overruns to, the parser resyncs on the next status
+  if ((USART_STATUS_REG(USART2) & USART_ORE_ISR) != 0) {
+    USART_CLEAR_ORE(USART2);
+  }
+  if (((USART_CR1(USART2) & USART_CR1_RXNEIE) != 0) &&
+      ((USART_STATUS_REG(USART2) & USART_RX_ISR) != 0)) {
+    data = usart_recv(USART2);
+    lastRx = (uint32_t)TICK_get();
+    RING_put(&midiRx, data);
+    SCHED_post(SCHED_EVENT_MIDI_RX);
+  }
+  if (((USART_CR1(USART2) & USART_CR1_TXEIE) != 0) &&
+      ((USART_STATUS_REG(USART2) & USART_TX_ISR) != 0)) {
+    if (RING_get(&midiRt, &data) || RING_get(&midiThru, &data) ||
+        RING_get(&midiTx, &data)) {
+      usart_send(USART2, data);
+      midiSent++;
+    } else {
+      USART_CR1(USART2) &= ~USART_CR1_TXEIE;
+      _midi_idle();
+    }
+  }
+}
+#endif
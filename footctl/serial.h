@@ -0,0 +1,56 @@
+#ifndef _SERIAL_H_INCLUDED_
+#define _SERIAL_H_INCLUDED_
+
+#include <stdint.h>
+#include "fbv.h"
+#include "pod.h"
+
+// ring sizes (power of 2); RX must absorb a full POD burst while
+// the main loop is busy, e.g. drawing the LCD
+#define SERIAL_FBV_TX_SIZE 64
+#define SERIAL_FBV_RX_SIZE 128
+// a footswitch macro plus a pedal burst
+#define SERIAL_MIDI_TX_SIZE 64
+// realtime bytes jump the queue; a start and a clock can be in flight
+#define SERIAL_MIDI_RT_SIZE 4
+// MIDI in is parsed as it streams, SysEx never needs to fit
+#define SERIAL_MIDI_RX_SIZE 64
+
+typedef struct serial_ring_stats_s {
+  uint16_t pending;
+  uint16_t peak;
+  uint32_t overflows;
+} SerialRingStats;
+
+// transmit side utilisation; busyTime is the time in ms the line spent
+// sending back to back with more bytes waiting
+typedef struct serial_tx_stats_s {
+  uint32_t queued;
+  uint32_t sent;
+  uint16_t pending;
+  uint16_t peak;
+  uint32_t overflows;
+  uint32_t busyTime;
+} SerialTxStats;
+
+void SERIAL_initialize(void);
+FBVTxResult SERIAL_fbv_send(const uint8_t* bytes, uint8_t size);
+uint16_t SERIAL_fbv_tx_pending(void);
+uint16_t SERIAL_fbv_recv(uint8_t* bytes, uint16_t size);
+void SERIAL_fbv_rx_stats(SerialRingStats* stats);
+PODTxResult SERIAL_midi_send(const uint8_t* bytes, uint8_t size);
+uint16_t SERIAL_midi_tx_pending(void);
+uint16_t SERIAL_midi_recv(uint8_t* bytes, uint16_t size);
+void SERIAL_midi_rx_stats(SerialRingStats* stats);
+void SERIAL_midi_realtime(uint8_t byte);
+void SERIAL_midi_thru(uint8_t byte);
+void SERIAL_midi_tx_stats(SerialTxStats* stats);
+uint8_t SERIAL_quiet(uint32_t ms);
+#ifdef VIRTUAL_HW
+void SERIAL_cycle(void);
+uint8_t SERIAL_busy(void);
+void SERIAL_fbv_inject(uint8_t byte);
+void SERIAL_midi_inject(uint8_t byte);
+#endif
+
+#endif
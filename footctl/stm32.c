@@ -4,7 +4,6 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/usart.h>
-#include <libopencm3/cm3/nvic.h>
 
 #ifdef STM32_MOCK
 #define INITIALIZE_LED_GPIO(LEDNUM)                                   \
@@ -72,9 +71,6 @@ void SYSTEM_initialize(void) {
   rcc_periph_clock_enable(RCC_GPIOF);
 #endif
 
-  // enable interrupts
-  nvic_enable_irq(NVIC_USART1_IRQ);
-
   // setup GPIOs
   // USART 2
 #ifdef STM32_MOCK
@@ -84,6 +80,12 @@ void SYSTEM_initialize(void) {
   gpio_mode_setup(GPIODEF_MIDI_TX_PORT, GPIO_MODE_AF, GPIO_PUPD_NONE,
                   GPIODEF_MIDI_TX_PIN);
   gpio_set_af(GPIODEF_MIDI_TX_PORT, GPIO_AF1, GPIODEF_MIDI_TX_PIN);
+#ifdef GPIODEF_MIDI_RX_PORT
+  // idle high, so an unplugged input doesn't float into the parser
+  gpio_mode_setup(GPIODEF_MIDI_RX_PORT, GPIO_MODE_AF, GPIO_PUPD_PULLUP,
+                  GPIODEF_MIDI_RX_PIN);
+  gpio_set_af(GPIODEF_MIDI_RX_PORT, GPIO_AF1, GPIODEF_MIDI_RX_PIN);
+#endif
 #endif
 
   // USART 1
@@ -138,15 +140,19 @@ void SYSTEM_initialize(void) {
   usart_set_stopbits(USART1, USART_CR2_STOPBITS_1);
   usart_set_mode(USART1, USART_MODE_TX_RX);
   usart_set_flow_control(USART1, USART_FLOWCONTROL_NONE);
-  USART_CR1(USART1) |= USART_CR1_RXNEIE;
 
   // MIDI
   usart_set_baudrate(USART2, 31250);
   usart_set_databits(USART2, 8);
   usart_set_parity(USART2, USART_PARITY_NONE);
   usart_set_stopbits(USART2, USART_CR2_STOPBITS_1);
+#ifdef GPIODEF_MIDI_RX_PORT
+  usart_set_mode(USART2, USART_MODE_TX_RX);
+#else
   usart_set_mode(USART2, USART_MODE_TX);
+#endif
   usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
+  // RX interrupts are enabled by SERIAL_initialize, once the rings are set up
 
   // enable tick
   systick_interrupt_enable();
@@ -0,0 +1,219 @@
+#include "store.h"
+#include "timer.h"
+#include "tick.h"
+#include "clock.h"
+#include "serial.h"
+#include <string.h>
+#ifdef VIRTUAL_HW
+#include <stdio.h>
+#else
+#include <libopencm3/stm32/flash.h>
+#endif
+
+// magic and size, then the data
+#define STORE_HEADER 4
+
+#define STORE_IDLE 0
+#define STORE_ERASING 1
+#define STORE_PROGRAMMING 2
+
+#ifdef VIRTUAL_HW
+// RAM stands in for the top of flash, down to the lowest store
+#define STORE_VIRTUAL_BASE 0x0800F000UL
+#define STORE_VIRTUAL_END 0x08010000UL
+static uint8_t virtualFlash[STORE_VIRTUAL_END - STORE_VIRTUAL_BASE];
+#define STORE_MEM(addr) (virtualFlash + ((addr) - STORE_VIRTUAL_BASE))
+#else
+#define STORE_MEM(addr) ((const uint8_t*)(addr))
+#endif
+
+typedef struct store_entry_s {
+  uint32_t addr;
+  uint16_t capacity;
+  uint16_t magic;
+  const uint8_t* data;
+  uint16_t size;
+  uint8_t state;
+  // bytes from addr done: erased while erasing, programmed after that
+  uint16_t pos;
+  // when the next step may run
+  tick_t due;
+} StoreEntry;
+
+typedef struct store_s {
+  StoreEntry entries[STORE_COUNT];
+  Timer step;
+} Store;
+
+static Store store;
+
+static void _step(tick_t now);
+
+#ifdef VIRTUAL_HW
+static void _erase(uint32_t addr) {
+  if (addr >= STORE_VIRTUAL_BASE && addr + STORE_PAGE_SIZE <= STORE_VIRTUAL_END) {
+    memset(STORE_MEM(addr), 0xFF, STORE_PAGE_SIZE);
+  }
+  printf("VSTORE: erase page 0x%08x\n", addr);
+}
+
+static void _program(uint32_t addr, uint16_t value) {
+  if (addr >= STORE_VIRTUAL_BASE && addr + 2 <= STORE_VIRTUAL_END) {
+    // flash only clears bits
+    STORE_MEM(addr)[0] &= (uint8_t)value;
+    STORE_MEM(addr)[1] &= (uint8_t)(value >> 8);
+  }
+}
+#else
+static inline void _erase(uint32_t addr) {
+  flash_unlock();
+  flash_erase_page(addr);
+  flash_lock();
+}
+
+static inline void _program(uint32_t addr, uint16_t value) {
+  flash_unlock();
+  flash_program_half_word(addr, value);
+  flash_lock();
+}
+#endif
+
+static inline uint16_t _read(uint32_t addr) {
+  return STORE_MEM(addr)[0] | (STORE_MEM(addr)[1] << 8);
+}
+
+// one page erase, or up to STORE_CHUNK half words
+static void _write_step(StoreEntry* entry) {
+  uint16_t end = STORE_HEADER + entry->size;
+  uint16_t value = 0;
+  uint16_t at = 0;
+  uint8_t i = 0;
+
+  if (entry->state == STORE_ERASING) {
+    _erase(entry->addr + entry->pos);
+    entry->pos += STORE_PAGE_SIZE;
+    if (entry->pos >= end) {
+      entry->state = STORE_PROGRAMMING;
+      entry->pos = STORE_HEADER;
+    }
+    return;
+  }
+  for (i = 0; i < STORE_CHUNK && entry->pos < end; i++, entry->pos += 2) {
+    at = entry->pos - STORE_HEADER;
+    // an odd size leaves the last byte erased
+    value = entry->data[at] | (at + 1 < entry->size ? entry->data[at + 1] << 8 : 0xFF00);
+    _program(entry->addr + entry->pos, value);
+  }
+  if (entry->pos >= end) {
+    // magic last, so a save cut short reads as never saved
+    _program(entry->addr + 2, entry->size);
+    _program(entry->addr, entry->magic);
+    entry->state = STORE_IDLE;
+#ifdef VIRTUAL_HW
+    printf("VSTORE: saved %u bytes at 0x%08x\n", entry->size, entry->addr);
+#endif
+  }
+}
+
+static void _arm(tick_t now) {
+  tick_t next = 0;
+  uint8_t pending = 0;
+  uint8_t i = 0;
+
+  for (i = 0; i < STORE_COUNT; i++) {
+    if (store.entries[i].state != STORE_IDLE && (!pending || store.entries[i].due < next)) {
+      next = store.entries[i].due;
+      pending = 1;
+    }
+  }
+  if (!pending) {
+    TIMER_stop(&store.step);
+    return;
+  }
+  TIMER_start(&store.step, next > now ? (uint32_t)(next - now) : 1, 0, _step);
+}
+
+static void _step(tick_t now) {
+  StoreEntry* entry = NULL;
+  uint8_t i = 0;
+
+  for (i = 0; i < STORE_COUNT; i++) {
+    if (store.entries[i].state != STORE_IDLE && store.entries[i].due <= now) {
+      entry = &store.entries[i];
+      break;
+    }
+  }
+  if (entry) {
+    if (CLOCK_is_running() || !SERIAL_quiet(STORE_QUIET_TIME)) {
+      // a stall now would drop bytes or clock pulses
+      entry->due = now + STORE_RETRY_INTERVAL;
+    } else {
+      _write_step(entry);
+      // the main loop gets a turn between steps
+      entry->due = now + 1;
+    }
+  }
+  _arm(now);
+}
+
+void STORE_initialize(void) {
+  memset(&store, 0, sizeof(Store));
+#ifdef VIRTUAL_HW
+  memset(virtualFlash, 0xFF, sizeof(virtualFlash));
+#endif
+}
+
+// addr is page aligned, capacity counts the header
+void STORE_configure(uint8_t id, uint32_t addr, uint16_t capacity, uint16_t magic) {
+  if (id >= STORE_COUNT) {
+    return;
+  }
+  STORE_cancel(id);
+  store.entries[id].addr = addr;
+  store.entries[id].capacity = capacity;
+  store.entries[id].magic = magic;
+}
+
+// the size saved, 0 if never saved or it doesn't fit
+uint16_t STORE_load(uint8_t id, void* data, uint16_t size) {
+  StoreEntry* entry = NULL;
+  uint16_t saved = 0;
+
+  if (id >= STORE_COUNT || !store.entries[id].capacity) {
+    return 0;
+  }
+  entry = &store.entries[id];
+  saved = _read(entry->addr + 2);
+  if (_read(entry->addr) != entry->magic || saved > size ||
+      STORE_HEADER + saved > entry->capacity) {
+    return 0;
+  }
+  memcpy(data, STORE_MEM(entry->addr + STORE_HEADER), saved);
+  return saved;
+}
+
+// data is read as it's written and must stay put until then; saving
+// again starts over
+void STORE_save(uint8_t id, const void* data, uint16_t size, uint32_t delay) {
+  StoreEntry* entry = NULL;
+  tick_t now = TICK_get();
+
+  if (id >= STORE_COUNT || STORE_HEADER + size > store.entries[id].capacity) {
+    return;
+  }
+  entry = &store.entries[id];
+  entry->data = (const uint8_t*)data;
+  entry->size = size;
+  entry->state = STORE_ERASING;
+  entry->pos = 0;
+  entry->due = now + delay;
+  _arm(now);
+}
+
+void STORE_cancel(uint8_t id) {
+  if (id >= STORE_COUNT) {
+    return;
+  }
+  store.entries[id].state = STORE_IDLE;
+  _arm(TICK_get());
+}
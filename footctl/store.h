@@ -0,0 +1,27 @@
+#ifndef _STORE_H_INCLUDED_
+#define _STORE_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// blocks of RAM kept in the top pages of flash. Erasing a page stalls
+// the core for tens of ms, interrupts included, so a save is written a
+// page erase or a few half words at a time, and only while the MIDI clock
+// is stopped and both lines have been quiet for STORE_QUIET_TIME ms
+#define STORE_PRESETS 0
+#define STORE_AUTOMATION 1
+#define STORE_COUNT 2
+
+#define STORE_QUIET_TIME 50
+// ms between tries while it isn't quiet
+#define STORE_RETRY_INTERVAL 100
+// half words programmed per step, ~50 us each
+#define STORE_CHUNK 16
+
+void STORE_initialize(void);
+void STORE_configure(uint8_t id, uint32_t addr, uint16_t capacity, uint16_t magic);
+uint16_t STORE_load(uint8_t id, void* data, uint16_t size);
+void STORE_save(uint8_t id, const void* data, uint16_t size, uint32_t delay);
+void STORE_cancel(uint8_t id);
+
+#endif
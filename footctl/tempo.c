@@ -0,0 +1,118 @@
+#include "tempo.h"
+#include <string.h>
+
+// tap intervals in ms
+#define TEMPO_MIN_INTERVAL (600000 / TEMPO_MAX_BPM10)
+#define TEMPO_MAX_INTERVAL (600000 / TEMPO_MIN_BPM10)
+// an interval further than 1/TEMPO_TOLERANCE off the average is an outlier
+#define TEMPO_TOLERANCE 4
+// consecutive outliers mean the player changed tempo
+#define TEMPO_MAX_OUTLIERS 2
+// fraction of the beat the LED stays lit
+#define TEMPO_LED_DUTY 4
+
+typedef struct tempo_s {
+  tick_t lastTap;
+  // last tap that agreed with the estimate, the beat is locked to it
+  tick_t anchor;
+  uint16_t intervals[TEMPO_HISTORY];
+  uint8_t count;
+  uint8_t next;
+  uint8_t outliers;
+  uint32_t sum;
+  uint16_t bpm10;
+} Tempo;
+
+static Tempo tempo;
+
+void TEMPO_initialize(void) {
+  memset(&tempo, 0, sizeof(Tempo));
+}
+
+static void _restart(void) {
+  tempo.count = 0;
+  tempo.next = 0;
+  tempo.sum = 0;
+  tempo.outliers = 0;
+}
+
+static void _push_interval(uint16_t interval) {
+  if (tempo.count == TEMPO_HISTORY) {
+    tempo.sum -= tempo.intervals[tempo.next];
+  } else {
+    tempo.count++;
+  }
+  tempo.intervals[tempo.next] = interval;
+  tempo.sum += interval;
+  tempo.next = (tempo.next + 1) % TEMPO_HISTORY;
+}
+
+// register a tap; returns 1 if the estimate changed
+uint8_t TEMPO_tap(tick_t now) {
+  uint32_t interval = (uint32_t)(now - tempo.lastTap);
+  uint32_t average = 0;
+  uint16_t bpm10 = 0;
+
+  if (interval < TEMPO_MIN_INTERVAL) {
+    // double hit, keep the first
+    return 0;
+  }
+  tempo.lastTap = now;
+
+  if (interval > TEMPO_MAX_INTERVAL) {
+    // first tap of a new gesture
+    _restart();
+    return 0;
+  }
+
+  if (tempo.count) {
+    average = tempo.sum / tempo.count;
+    if (interval > average + average / TEMPO_TOLERANCE ||
+        interval < average - average / TEMPO_TOLERANCE) {
+      if (++tempo.outliers < TEMPO_MAX_OUTLIERS) {
+        return 0;
+      }
+      _restart();
+    }
+  }
+  tempo.outliers = 0;
+  tempo.anchor = now;
+  _push_interval((uint16_t)interval);
+
+  // rounded 600000 / average
+  bpm10 = (uint16_t)((600000UL * tempo.count + tempo.sum / 2) / tempo.sum);
+  if (bpm10 == tempo.bpm10) {
+    return 0;
+  }
+  tempo.bpm10 = bpm10;
+  return 1;
+}
+
+// ms until TEMPO_beat changes, 0 without a tempo
+uint32_t TEMPO_next_change(tick_t now) {
+  uint32_t period = 0;
+  uint32_t phase = 0;
+
+  if (!tempo.bpm10) {
+    return 0;
+  }
+  period = 600000UL / tempo.bpm10;
+  phase = (uint32_t)(now - tempo.anchor) % period;
+  return phase < period / TEMPO_LED_DUTY ? period / TEMPO_LED_DUTY - phase : period - phase;
+}
+
+// 0 until two taps made an estimate
+uint16_t TEMPO_get_bpm10(void) {
+  return tempo.bpm10;
+}
+
+// beat indicator, phase locked to the last tap
+uint8_t TEMPO_beat(tick_t now) {
+  uint32_t period = 0;
+
+  if (!tempo.bpm10) {
+    return 0;
+  }
+  period = 600000UL / tempo.bpm10;
+  return ((uint32_t)(now - tempo.anchor) % period) < period / TEMPO_LED_DUTY;
+}
@@ -0,0 +1,19 @@
+#ifndef _TEMPO_H_INCLUDED_
+#define _TEMPO_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// tempo is expressed in tenths of BPM, the POD's 30.0 - 240.0 range
+#define TEMPO_MIN_BPM10 300
+#define TEMPO_MAX_BPM10 2400
+// intervals averaged into the estimate
+#define TEMPO_HISTORY 4
+
+void TEMPO_initialize(void);
+uint8_t TEMPO_tap(tick_t now);
+uint16_t TEMPO_get_bpm10(void);
+uint8_t TEMPO_beat(tick_t now);
+uint32_t TEMPO_next_change(tick_t now);
+
+#endif
@@ -17,7 +17,13 @@ static inline struct timespec timeDiff(struct timespec oldTime, struct timespec
 }
 #else
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/systick.h>
+#include "sched.h"
 static volatile tick_t counter = 0;
+// the tick the main loop sleeps until, 0 for none
+static volatile tick_t wakeAt = 0;
 #endif
 
 void TICK_initialize(void) {
@@ -44,6 +50,30 @@ tick_t TICK_get(void) {
   return 0;
 }
 
+// finer grained time for measurements
+uint64_t TICK_get_us(void) {
+#ifdef VIRTUAL_HW
+  struct timespec now, diff;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  diff = timeDiff(_VHW_initial_time, now);
+  return (uint64_t)diff.tv_sec * 1000000 + diff.tv_nsec / 1000;
+#else
+  // SysTick counts down through each ms
+  uint32_t reload = systick_get_reload();
+  uint32_t masked = cm_mask_interrupts(1);
+  uint64_t ms = counter;
+  uint32_t value = systick_get_value();
+
+  if (SCB_ICSR & SCB_ICSR_PENDSTSET) {
+    // it wrapped, the interrupt counting it is still pending
+    ms++;
+    value = systick_get_value();
+  }
+  cm_mask_interrupts(masked);
+  return ms * 1000 + (uint64_t)(reload - value) * 1000 / (reload + 1);
+#endif
+}
+
 void TICK_wait(tick_t duration) {
   tick_t start = TICK_get();
 
@@ -51,7 +81,17 @@ void TICK_wait(tick_t duration) {
 }
 
 #ifndef VIRTUAL_HW
+// with interrupts disabled, as the ISR reads it
+void TICK_set_wakeup(tick_t deadline) {
+  wakeAt = deadline;
+}
+
+// counts every ms, but only wakes the main loop at its deadline
 void sys_tick_handler(void) {
   counter++;
+  if (wakeAt && counter >= wakeAt) {
+    wakeAt = 0;
+    SCHED_post(SCHED_EVENT_TICK);
+  }
 }
 #endif
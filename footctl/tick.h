@@ -7,5 +7,9 @@
 void TICK_initialize(void);
 tick_t TICK_get(void);
 void TICK_wait(tick_t duration);
+uint64_t TICK_get_us(void);
+#ifndef VIRTUAL_HW
+void TICK_set_wakeup(tick_t deadline);
+#endif
 
 #endif
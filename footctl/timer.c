@@ -0,0 +1,179 @@
+#include "timer.h"
+#include <string.h>
+
+#define TIMER_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+// the furthest ahead a timer is placed; later ones are parked in the last
+// level and placed again when their slot comes round
+#define TIMER_RANGE ((tick_t)1 << (TIMER_WHEEL_BITS * TIMER_LEVELS))
+// a timer taken out of the wheel to be run
+#define TIMER_SLOT_NONE 0xFF
+
+// slot is level << TIMER_WHEEL_BITS | index; a bit of used per slot, so
+// TIMER_WHEEL_BITS can't go past 4
+typedef struct timer_wheel_s {
+  Timer* slots[TIMER_LEVELS * TIMER_SLOTS];
+  uint32_t used[TIMER_LEVELS];
+  // next tick to run
+  tick_t current;
+} TimerWheel;
+
+static TimerWheel wheel;
+
+void TIMER_initialize(tick_t now) {
+  memset(&wheel, 0, sizeof(TimerWheel));
+  wheel.current = now + 1;
+}
+
+static void _unlink(Timer* timer) {
+  *timer->pprev = timer->next;
+  if (timer->next) {
+    timer->next->pprev = timer->pprev;
+  }
+  if (timer->slot != TIMER_SLOT_NONE && !wheel.slots[timer->slot]) {
+    wheel.used[timer->slot >> TIMER_WHEEL_BITS] &= ~(1UL << (timer->slot & TIMER_SLOT_MASK));
+  }
+  timer->pprev = NULL;
+}
+
+static void _insert(Timer* timer) {
+  tick_t expires = timer->expires < wheel.current ? wheel.current : timer->expires;
+  tick_t delta = expires - wheel.current;
+  Timer** head = NULL;
+  uint8_t level = 0;
+  uint8_t index = 0;
+
+  if (delta >= TIMER_RANGE) {
+    expires = wheel.current + TIMER_RANGE - 1;
+    level = TIMER_LEVELS - 1;
+  } else {
+    while (delta >> (TIMER_WHEEL_BITS * (level + 1))) {
+      level++;
+    }
+  }
+  index = (uint8_t)(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+  timer->slot = (level << TIMER_WHEEL_BITS) | index;
+  head = &wheel.slots[timer->slot];
+
+  timer->next = *head;
+  if (timer->next) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+  wheel.used[level] |= 1UL << index;
+}
+
+// a turn of the level below is over: move the next slot of this level
+// down, returns its index
+static uint8_t _cascade(uint8_t level) {
+  uint8_t index = (uint8_t)(wheel.current >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+  Timer** head = &wheel.slots[(level << TIMER_WHEEL_BITS) | index];
+  Timer* timer = *head;
+  Timer* next = NULL;
+
+  *head = NULL;
+  wheel.used[level] &= ~(1UL << index);
+  while (timer) {
+    next = timer->next;
+    _insert(timer);
+    timer = next;
+  }
+  return index;
+}
+
+// delay is in ms from the last tick run; restarts an armed timer
+void TIMER_start(Timer* timer, uint32_t delay, uint32_t period, TimerCallback callback) {
+  if (!callback) {
+    return;
+  }
+  TIMER_stop(timer);
+  timer->expires = wheel.current - 1 + (delay ? delay : 1);
+  timer->period = period;
+  timer->callback = callback;
+  _insert(timer);
+}
+
+void TIMER_stop(Timer* timer) {
+  if (timer->pprev) {
+    _unlink(timer);
+  }
+}
+
+uint8_t TIMER_is_active(const Timer* timer) {
+  return timer->pprev != NULL;
+}
+
+// call on every pass of the main loop; runs the ticks up to now, so
+// periodic timers keep their rate when the loop was held up
+void TIMER_cycle(tick_t now) {
+  Timer* pending = NULL;
+  Timer* timer = NULL;
+  uint8_t index = 0;
+  uint8_t level = 0;
+
+  while (wheel.current <= now) {
+    index = (uint8_t)wheel.current & TIMER_SLOT_MASK;
+    if (!index) {
+      for (level = 1; level < TIMER_LEVELS && !_cascade(level); level++);
+    }
+    // the slot is run from a list of its own, callbacks may start or
+    // stop any timer
+    pending = wheel.slots[index];
+    if (pending) {
+      wheel.slots[index] = NULL;
+      wheel.used[0] &= ~(1UL << index);
+      pending->pprev = &pending;
+      for (timer = pending; timer; timer = timer->next) {
+        timer->slot = TIMER_SLOT_NONE;
+      }
+    }
+    wheel.current++;
+
+    while ((timer = pending)) {
+      _unlink(timer);
+      if (timer->period) {
+        // from when it was due, not when it ran
+        timer->expires += timer->period;
+        _insert(timer);
+      }
+      (timer->callback)(now);
+    }
+  }
+}
+
+// the earliest tick the wheel has work at, 0 without armed timers. A slot
+// of the upper levels counts as due when it comes down, so the result is
+// never late but may be early
+tick_t TIMER_next_deadline(void) {
+  tick_t deadline = 0;
+  tick_t due = 0;
+  uint32_t used = 0;
+  uint8_t shift = 0;
+  uint8_t index = 0;
+  uint8_t offset = 0;
+  uint8_t level = 0;
+
+  for (level = 0; level < TIMER_LEVELS; level++) {
+    if (!wheel.used[level]) {
+      continue;
+    }
+    shift = TIMER_WHEEL_BITS * level;
+    index = (uint8_t)(wheel.current >> shift) & TIMER_SLOT_MASK;
+    // rotate so the slot of the current tick comes first
+    used = ((wheel.used[level] >> index) | (wheel.used[level] << (TIMER_SLOTS - index))) &
+      ((1UL << TIMER_SLOTS) - 1);
+    if ((used & 1) && (wheel.current & (((tick_t)1 << shift) - 1))) {
+      // its turn came already, what is left there is for the next one
+      used = (used & ~1UL) | (1UL << TIMER_SLOTS);
+    }
+    for (offset = 0; !(used & 1); offset++) {
+      used >>= 1;
+    }
+    due = ((wheel.current >> shift) + offset) << shift;
+    if (!deadline || due < deadline) {
+      deadline = due;
+    }
+  }
+  return deadline;
+}
@@ -0,0 +1,33 @@
+#ifndef _TIMER_H_INCLUDED_
+#define _TIMER_H_INCLUDED_
+
+#include <stdint.h>
+#include "config.h"
+
+// each level has 1 << TIMER_WHEEL_BITS slots, a slot of a level spans a
+// whole turn of the one below: 16 ms, 256 ms, 4 s and 65 s
+#define TIMER_WHEEL_BITS 4
+#define TIMER_LEVELS 4
+
+typedef void (*TimerCallback)(tick_t now);
+
+// owned by the caller, zeroed before the first use
+typedef struct timer_s {
+  struct timer_s* next;
+  // link pointing to this timer, NULL while not armed
+  struct timer_s** pprev;
+  tick_t expires;
+  // 0 for a one shot
+  uint32_t period;
+  TimerCallback callback;
+  uint8_t slot;
+} Timer;
+
+void TIMER_initialize(tick_t now);
+void TIMER_start(Timer* timer, uint32_t delay, uint32_t period, TimerCallback callback);
+void TIMER_stop(Timer* timer);
+uint8_t TIMER_is_active(const Timer* timer);
+void TIMER_cycle(tick_t now);
+tick_t TIMER_next_deadline(void);
+
+#endif
@@ -13,143 +13,324 @@
 // user flag mask
 #define FBV_USR_FLAG_MASK 0xF0
 
-// other
-#define RX_BUFFER_SIZE MAX_PARAM_SIZE + 2
+// command byte to dense index; unknown commands map to FBV_CMD_IDX_OTHER
+static const uint8_t FBV_CMD_TABLE[256] =
+  {
+   [FBV_PING] = FBV_CMD_IDX_PING,
+   [FBV_SET_LED] = FBV_CMD_IDX_SET_LED,
+   [FBV_TUN_STAT] = FBV_CMD_IDX_TUN_STAT,
+   [FBV_SET_FLAT] = FBV_CMD_IDX_SET_FLAT,
+   [FBV_SET_BNK1] = FBV_CMD_IDX_SET_BNK1,
+   [FBV_SET_BNK2] = FBV_CMD_IDX_SET_BNK2,
+   [FBV_SET_CH] = FBV_CMD_IDX_SET_CH,
+   [FBV_SET_TXT] = FBV_CMD_IDX_SET_TXT,
+   [FBV_HNDSHAKE] = FBV_CMD_IDX_HNDSHAKE,
+   [FBV_ACK] = FBV_CMD_IDX_ACK,
+   [FBV_BTN_STAT] = FBV_CMD_IDX_BTN_STAT,
+   [FBV_CTL_STAT] = FBV_CMD_IDX_CTL_STAT,
+   [FBV_PROBE] = FBV_CMD_IDX_PROBE
+  };
 
-typedef struct fbv_state_machine_s {
-  uint8_t state;
-  uint8_t flags;
-  uint8_t rxBuffer[RX_BUFFER_SIZE];
-  uint8_t wrPtr;
-  uint8_t pendingBytes;
-  FBVStateMachineConfig cfg;
-} FBVStateMachine;
+// default instance
+static FBVContext fsm;
 
+// hand complete frame to callbacks
+static void fbv_deliver(FBVContext* ctx, uint8_t cmd, uint8_t paramSize,
+                        const uint8_t* params) {
+  FBVMessageView view;
+  FBVMessage msg;
+  uint8_t idx = FBV_CMD_TABLE[cmd];
 
-static FBVStateMachine fsm;
+  ctx->stats.frames++;
+  ctx->stats.cmdCounts[idx]++;
 
-// done receiving packet
-static void fbv_rx_done(void) {
-  FBVMessage msg = {0};
-  fsm.wrPtr = 0;
+  view.msgType = cmd;
+  view.paramSize = paramSize;
+  view.params = params;
+  if (ctx->cfg.msgRxCtx) {
+    (ctx->cfg.msgRxCtx)(ctx, &view);
+  }
+  if (ctx->handlers[idx]) {
+    (ctx->handlers[idx])(ctx, &view);
+  }
 
-  // save message
-  msg.paramSize = fsm.rxBuffer[0] - 1;
-  msg.msgType = fsm.rxBuffer[1];
-  memcpy(msg.params, fsm.rxBuffer+2, fsm.rxBuffer[0] - 1);
+  // legacy callback gets its own copy
+  if (ctx->cfg.msgRx) {
+    memset(&msg, 0, sizeof(FBVMessage));
+    msg.paramSize = paramSize;
+    msg.msgType = cmd;
+    memcpy(msg.params, params, paramSize);
 
-  if (msg.msgType == FBV_SET_TXT) {
-    // null terminated string
-    msg.params[msg.paramSize+1] = 0;
+    if (msg.msgType == FBV_SET_TXT) {
+      // null terminated string
+      msg.params[msg.paramSize+1] = 0;
+    }
+    (ctx->cfg.msgRx)(msg);
   }
+}
 
-  // callback with received message
-  if (fsm.cfg.msgRx) {
-    (fsm.cfg.msgRx)(msg);
-  }
+// done receiving packet
+static void fbv_rx_done(FBVContext* ctx) {
+  ctx->wrPtr = 0;
+  fbv_deliver(ctx, ctx->rxBuffer[1], ctx->rxBuffer[0] - 1, ctx->rxBuffer+2);
 }
 
 // get flags
-uint8_t FBV_get_flags(void) {
-  uint8_t flags = fsm.flags;
-  fsm.flags &= ~FBV_USR_FLAG_MASK;
+uint8_t FBV_ctx_get_flags(FBVContext* ctx) {
+  uint8_t flags = ctx->flags;
+  uint32_t overruns = ctx->lineOverruns;
+
+  ctx->flags &= ~FBV_USR_FLAG_MASK;
+  // overruns since the last call
+  if (overruns != ctx->seenOverruns) {
+    ctx->seenOverruns = overruns;
+    flags |= FBV_FLAG_ERR;
+  }
   return flags & FBV_USR_FLAG_MASK;
 }
 
 // Initialize state machine
-void FBV_initialize(FBVStateMachineConfig* cfg) {
-  fsm.state = FBV_STATE_RX_HDR;
+void FBV_ctx_initialize(FBVContext* ctx, FBVStateMachineConfig* cfg) {
+  ctx->state = FBV_STATE_RX_HDR;
   if (cfg) {
-    fsm.cfg = *cfg;
+    ctx->cfg = *cfg;
   }
   else {
-    memset(&fsm.cfg, 0, sizeof(FBVStateMachineConfig));
+    memset(&ctx->cfg, 0, sizeof(FBVStateMachineConfig));
   }
-  fsm.wrPtr = 0;
-  fsm.pendingBytes = 0;
-  fsm.flags = FBV_FLAG_INIT;
+  ctx->wrPtr = 0;
+  ctx->pendingBytes = 0;
+  ctx->flags = FBV_FLAG_INIT;
+  memset(ctx->handlers, 0, sizeof(ctx->handlers));
+  memset(&ctx->stats, 0, sizeof(FBVStats));
+  ctx->lineOverruns = 0;
+  ctx->seenOverruns = 0;
+  ctx->clearedOverruns = 0;
 }
 
-// receive byte and parse
-void FBV_recv_byte(uint8_t byte) {
-  if (!(fsm.flags & FBV_FLAG_INIT)){
-    // not initialized
-    return;
+// map command byte to dense index
+FBVCommandIndex FBV_cmd_index(uint8_t cmd) {
+  return (FBVCommandIndex)FBV_CMD_TABLE[cmd];
+}
+
+// subscribe to a known command, replaces previous handler; pass NULL
+// to unsubscribe
+uint8_t FBV_ctx_register(FBVContext* ctx, FBVMessageType cmd,
+                         FBVContextCallback handler) {
+  uint8_t idx = FBV_CMD_TABLE[(uint8_t)cmd];
+  if (idx == FBV_CMD_IDX_OTHER) {
+    return 0;
   }
+  ctx->handlers[idx] = handler;
+  return 1;
+}
 
-  switch (fsm.state) {
+// parse a single byte
+static void fbv_parse_byte(FBVContext* ctx, uint8_t byte) {
+  switch (ctx->state) {
   case FBV_STATE_RX_HDR:
     if (byte != 0xF0) {
+      ctx->stats.resyncBytes++;
       break;
     }
-    fsm.state = FBV_STATE_RX_LEN;
-    fsm.wrPtr = 0;
+    ctx->state = FBV_STATE_RX_LEN;
+    ctx->wrPtr = 0;
     break;
   case FBV_STATE_RX_LEN:
+    if (!byte) {
+      // no room for a command, drop it
+      ctx->stats.truncatedFrames++;
+      ctx->flags |= FBV_FLAG_ERR;
+      ctx->state = FBV_STATE_RX_HDR;
+      break;
+    }
     if (byte > MAX_PARAM_SIZE) {
+      // keep what fits, the rest will be discarded as garbage
+      ctx->stats.truncatedFrames++;
+      ctx->flags |= FBV_FLAG_ERR;
       byte = MAX_PARAM_SIZE;
     }
-    fsm.pendingBytes = byte;
-    fsm.rxBuffer[fsm.wrPtr++] = byte;
-    fsm.state = FBV_STATE_RX_CMD;
+    ctx->pendingBytes = byte;
+    ctx->rxBuffer[ctx->wrPtr++] = byte;
+    ctx->state = FBV_STATE_RX_CMD;
     break;
   case FBV_STATE_RX_CMD:
-    fsm.rxBuffer[fsm.wrPtr++] = byte;
-    fsm.pendingBytes--;
-    fsm.state = FBV_STATE_RX_PRM;
+    ctx->rxBuffer[ctx->wrPtr++] = byte;
+    ctx->pendingBytes--;
+    if (!ctx->pendingBytes) {
+      // command without parameters
+      ctx->state = FBV_STATE_RX_HDR;
+      fbv_rx_done(ctx);
+      break;
+    }
+    ctx->state = FBV_STATE_RX_PRM;
     break;
   case FBV_STATE_RX_PRM:
-    fsm.rxBuffer[fsm.wrPtr++] = byte;
-    fsm.pendingBytes--;
-    if (!fsm.pendingBytes) {
-      fsm.state = FBV_STATE_RX_HDR;
-      fbv_rx_done();
+    ctx->rxBuffer[ctx->wrPtr++] = byte;
+    ctx->pendingBytes--;
+    if (!ctx->pendingBytes) {
+      ctx->state = FBV_STATE_RX_HDR;
+      fbv_rx_done(ctx);
       break;
     }
     break;
   default:
-    fsm.pendingBytes = 0;
-    fsm.wrPtr = 0;
-    fsm.state = FBV_STATE_RX_HDR;
-    fsm.flags |= FBV_FLAG_ERR;
+    ctx->pendingBytes = 0;
+    ctx->wrPtr = 0;
+    ctx->state = FBV_STATE_RX_HDR;
+    ctx->flags |= FBV_FLAG_ERR;
     break;
   }
 
 }
 
-// receive multiple bytes
-void FBV_recv_bytes(uint8_t* bytes, unsigned int size) {
+// receive byte and parse
+void FBV_ctx_recv_byte(FBVContext* ctx, uint8_t byte) {
+  if (!(ctx->flags & FBV_FLAG_INIT)){
+    // not initialized
+    return;
+  }
+
+  ctx->stats.bytes++;
+  fbv_parse_byte(ctx, byte);
+}
+
+// receive multiple bytes; frames fully contained in the buffer are
+// delivered in place, anything else goes through the byte state machine
+void FBV_ctx_recv_bytes(FBVContext* ctx, const uint8_t* bytes, unsigned int size) {
+  const uint8_t* hdr = NULL;
+  uint8_t len = 0;
+
+  if (!(ctx->flags & FBV_FLAG_INIT)) {
+    return;
+  }
+
+  ctx->stats.bytes += size;
   while (size) {
-    FBV_recv_byte(*bytes);
+    if (ctx->state != FBV_STATE_RX_HDR) {
+      // finish frame started in a previous buffer
+      fbv_parse_byte(ctx, *bytes);
+      bytes++;
+      size--;
+      continue;
+    }
+
+    // hunt for next header
+    hdr = memchr(bytes, 0xF0, size);
+    if (!hdr) {
+      ctx->stats.resyncBytes += size;
+      break;
+    }
+    ctx->stats.resyncBytes += hdr - bytes;
+    size -= hdr - bytes;
+    bytes = hdr;
+
+    if (size >= 2) {
+      len = bytes[1];
+      if (len && len <= MAX_PARAM_SIZE && size >= (unsigned int)len + 2) {
+        // contiguous frame
+        fbv_deliver(ctx, bytes[2], len - 1, bytes + 3);
+        bytes += len + 2;
+        size -= len + 2;
+        continue;
+      }
+    }
+
+    // partial or malformed frame
+    fbv_parse_byte(ctx, *bytes);
     bytes++;
     size--;
   }
 }
 
 // send message
-void FBV_send_msg(FBVMessage* msg) {
-  unsigned int paramSize = 0;
+FBVTxResult FBV_ctx_send_msg(FBVContext* ctx, FBVMessage* msg) {
+  uint8_t frame[FBV_MAX_FRAME_SIZE];
+  uint8_t i = 0;
   if (!msg) {
-    return;
+    return FBV_TX_INVALID;
   }
 
-  if (!(fsm.flags & FBV_FLAG_INIT)) {
-    return;
+  if (!(ctx->flags & FBV_FLAG_INIT)) {
+    return FBV_TX_INVALID;
+  }
+
+  if (msg->paramSize > MAX_PARAM_SIZE) {
+    return FBV_TX_INVALID;
   }
 
-  // just call the send byte function if available
-  if (fsm.cfg.msgTx) {
-    // send header
-    (fsm.cfg.msgTx)(0xF0);
-    // send length
-    (fsm.cfg.msgTx)(msg->paramSize + 1);
-    // send command
-    (fsm.cfg.msgTx)(msg->msgType);
-    // send params
-    paramSize = msg->paramSize;
-    while (paramSize) {
-      (fsm.cfg.msgTx)(msg->params[msg->paramSize-paramSize]);
-      paramSize--;
+  // build frame
+  frame[0] = 0xF0;
+  frame[1] = msg->paramSize + 1;
+  frame[2] = msg->msgType;
+  memcpy(frame+3, msg->params, msg->paramSize);
+
+  // hand the whole frame over if possible
+  if (ctx->cfg.msgTxBulk) {
+    return (ctx->cfg.msgTxBulk)(frame, msg->paramSize + 3);
+  }
+
+  // otherwise call the send byte function if available
+  if (ctx->cfg.msgTx) {
+    for (i=0; i<msg->paramSize + 3; i++) {
+      (ctx->cfg.msgTx)(frame[i]);
     }
   }
+  return FBV_TX_OK;
+}
+
+// statistics
+void FBV_ctx_get_stats(FBVContext* ctx, FBVStats* stats) {
+  if (!stats) {
+    return;
+  }
+  memcpy(stats, &ctx->stats, sizeof(FBVStats));
+  stats->overruns = ctx->lineOverruns - ctx->clearedOverruns;
+}
+
+void FBV_ctx_clear_stats(FBVContext* ctx) {
+  memset(&ctx->stats, 0, sizeof(FBVStats));
+  ctx->clearedOverruns = ctx->lineOverruns;
+}
+
+// may be called from interrupt context, so it touches nothing else
+void FBV_ctx_line_overrun(FBVContext* ctx) {
+  ctx->lineOverruns++;
+}
+
+// default instance wrappers
+uint8_t FBV_get_flags(void) {
+  return FBV_ctx_get_flags(&fsm);
+}
+
+void FBV_initialize(FBVStateMachineConfig* cfg) {
+  FBV_ctx_initialize(&fsm, cfg);
+}
+
+void FBV_recv_byte(uint8_t byte) {
+  FBV_ctx_recv_byte(&fsm, byte);
+}
+
+void FBV_recv_bytes(const uint8_t* bytes, unsigned int size) {
+  FBV_ctx_recv_bytes(&fsm, bytes, size);
+}
+
+FBVTxResult FBV_send_msg(FBVMessage* msg) {
+  return FBV_ctx_send_msg(&fsm, msg);
+}
+
+void FBV_get_stats(FBVStats* stats) {
+  FBV_ctx_get_stats(&fsm, stats);
+}
+
+void FBV_clear_stats(void) {
+  FBV_ctx_clear_stats(&fsm);
+}
+
+void FBV_line_overrun(void) {
+  FBV_ctx_line_overrun(&fsm);
+}
+
+uint8_t FBV_register(FBVMessageType cmd, FBVContextCallback handler) {
+  return FBV_ctx_register(&fsm, cmd, handler);
 }
@@ -5,6 +5,8 @@
 
 // maximum parameter payload size
 #define MAX_PARAM_SIZE 19
+// maximum frame size on the wire: header, length, command, params
+#define FBV_MAX_FRAME_SIZE (MAX_PARAM_SIZE + 3)
 
 // user readable flags
 #define FBV_FLAG_ERR 0x10
@@ -18,6 +20,7 @@ typedef enum fbv_message_type_e
    FBV_SET_BNK1 = 0x0A,
    FBV_SET_BNK2 = 0x0B,
    FBV_TUN_STAT = 0x08,
+   FBV_SET_FLAT = 0x20,
    FBV_BTN_STAT = 0x81,
    FBV_CTL_STAT = 0x82,
    FBV_HNDSHAKE = 0x30,
@@ -42,24 +45,146 @@ typedef enum fbv_led_type_e
    FBV_LED_WAH = 0x13
   } FBVLED;
 
+// footswitch ids reported with FBV_BTN_STAT; they mirror the LED ids
+typedef enum fbv_switch_type_e
+  {
+   FBV_SW_BANK_DN = 0x00,
+   FBV_SW_BANK_UP = 0x10,
+   FBV_SW_TAP = 0x61,
+   FBV_SW_MOD = 0x41,
+   FBV_SW_DLY = 0x51,
+   FBV_SW_CHA = 0x20,
+   FBV_SW_CHB = 0x30,
+   FBV_SW_CHC = 0x40,
+   FBV_SW_CHD = 0x50,
+   FBV_SW_SB1 = 0x12,
+   FBV_SW_SB2 = 0x22,
+   FBV_SW_SB3 = 0x32,
+   FBV_SW_AMP = 0x01,
+   FBV_SW_REV = 0x21,
+   FBV_SW_WAH = 0x13
+  } FBVSwitch;
+
+// continuous controller ids reported with FBV_CTL_STAT
+typedef enum fbv_control_type_e
+  {
+   FBV_CTL_PEDAL1 = 0x00,
+   FBV_CTL_PEDAL2 = 0x01
+  } FBVControl;
+
+// dense indices for per-command statistics and dispatch
+typedef enum fbv_cmd_index_e
+  {
+   FBV_CMD_IDX_OTHER = 0,
+   FBV_CMD_IDX_PING,
+   FBV_CMD_IDX_SET_LED,
+   FBV_CMD_IDX_TUN_STAT,
+   FBV_CMD_IDX_SET_FLAT,
+   FBV_CMD_IDX_SET_BNK1,
+   FBV_CMD_IDX_SET_BNK2,
+   FBV_CMD_IDX_SET_CH,
+   FBV_CMD_IDX_SET_TXT,
+   FBV_CMD_IDX_HNDSHAKE,
+   FBV_CMD_IDX_ACK,
+   FBV_CMD_IDX_BTN_STAT,
+   FBV_CMD_IDX_CTL_STAT,
+   FBV_CMD_IDX_PROBE,
+   FBV_CMD_COUNT
+  } FBVCommandIndex;
+
+// link statistics, counters wrap around
+typedef struct fbv_stats_s {
+  uint32_t frames;
+  uint32_t bytes;
+  // bytes discarded while hunting for a header
+  uint32_t resyncBytes;
+  // frames with a zero or oversized length byte
+  uint32_t truncatedFrames;
+  // receive overruns reported by the transport
+  uint32_t overruns;
+  uint32_t cmdCounts[FBV_CMD_COUNT];
+} FBVStats;
+
 typedef struct fbv_message_s {
   FBVMessageType msgType;
   uint8_t params[MAX_PARAM_SIZE+1];
   uint8_t paramSize;
 } FBVMessage;
 
+typedef enum fbv_tx_result_e
+  {
+   FBV_TX_OK = 0,
+   FBV_TX_FULL = 1,
+   FBV_TX_INVALID = 2
+  } FBVTxResult;
+
+// read-only view of a received frame; params points either into the
+// buffer handed to FBV_ctx_recv_bytes or into the context and is only
+// valid for the duration of the callback
+typedef struct fbv_message_view_s {
+  FBVMessageType msgType;
+  uint8_t paramSize;
+  const uint8_t* params;
+} FBVMessageView;
+
+typedef struct fbv_state_machine_s FBVContext;
+
 typedef void (*FBVMessageCallback)(FBVMessage);
+typedef void (*FBVContextCallback)(FBVContext*, const FBVMessageView*);
 typedef void (*FBVMessageSendByte)(uint8_t);
+typedef FBVTxResult (*FBVMessageSendBytes)(const uint8_t*, uint8_t);
 
+// msgRxCtx is called for every frame before msgRx and before any handler
+// registered for the command, with a zero-copy view and the receiving
+// context, which carries the user pointer; msgTxBulk takes precedence
+// over msgTx and receives whole frames
 typedef struct fbv_fsm_cfg_s {
   FBVMessageCallback msgRx;
+  FBVContextCallback msgRxCtx;
   FBVMessageSendByte msgTx;
+  FBVMessageSendBytes msgTxBulk;
+  void* user;
 } FBVStateMachineConfig;
 
+// parser state; storage is owned by the caller, one per link
+struct fbv_state_machine_s {
+  uint8_t state;
+  uint8_t flags;
+  uint8_t rxBuffer[MAX_PARAM_SIZE + 2];
+  uint8_t wrPtr;
+  uint8_t pendingBytes;
+  FBVStateMachineConfig cfg;
+  FBVContextCallback handlers[FBV_CMD_COUNT];
+  FBVStats stats;
+  // only written by FBV_ctx_line_overrun, which may run in an interrupt;
+  // the main loop compares it with what it saw last
+  volatile uint32_t lineOverruns;
+  uint32_t seenOverruns;
+  uint32_t clearedOverruns;
+};
+
+// reentrant interface
+uint8_t FBV_ctx_get_flags(FBVContext* ctx);
+void FBV_ctx_initialize(FBVContext* ctx, FBVStateMachineConfig* cfg);
+void FBV_ctx_recv_byte(FBVContext* ctx, uint8_t byte);
+void FBV_ctx_recv_bytes(FBVContext* ctx, const uint8_t* bytes, unsigned int size);
+FBVTxResult FBV_ctx_send_msg(FBVContext* ctx, FBVMessage* msg);
+void FBV_ctx_get_stats(FBVContext* ctx, FBVStats* stats);
+void FBV_ctx_clear_stats(FBVContext* ctx);
+void FBV_ctx_line_overrun(FBVContext* ctx);
+uint8_t FBV_ctx_register(FBVContext* ctx, FBVMessageType cmd,
+                         FBVContextCallback handler);
+FBVCommandIndex FBV_cmd_index(uint8_t cmd);
+
+// default instance
 uint8_t FBV_get_flags(void);
 void FBV_initialize(FBVStateMachineConfig* cfg);
 void FBV_recv_byte(uint8_t byte);
-void FBV_recv_bytes(uint8_t* bytes, unsigned int size);
-void FBV_send_msg(FBVMessage* msg);
+void FBV_recv_bytes(const uint8_t* bytes, unsigned int size);
+FBVTxResult FBV_send_msg(FBVMessage* msg);
+void FBV_get_stats(FBVStats* stats);
+void FBV_clear_stats(void);
+void FBV_line_overrun(void);
+uint8_t FBV_register(FBVMessageType cmd, FBVContextCallback handler);
 
 #endif
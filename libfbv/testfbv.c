@@ -11,8 +11,8 @@ void message_received(FBVMessage msg) {
   case FBV_SET_LED:
     printf("SET LED 0x%x to %s", msg.params[0], msg.params[1] ? "ON" : "OFF");
     break;
-  case FBV_ACK_PING:
-    printf("ACK/PING");
+  case FBV_PING:
+    printf("PING");
     break;
   case FBV_SET_TXT:
     printf("SET TXT to '%s'", msg.params+2);
@@ -54,11 +54,13 @@ static FBVStateMachineConfig fsmCfg =
    .msgTx = dummy_send_byte
   };
 
+#define READ_CHUNK_SIZE 4096
+
 // load dump
 static int load_dump(const char* path) {
   FILE* fp = NULL;
-  int ret = 0;
-  uint8_t read = 0;
+  size_t ret = 0;
+  uint8_t chunk[READ_CHUNK_SIZE];
 
   if (!path) {
     printf("ERROR: cannot read file: %s\n", path);
@@ -71,17 +73,23 @@ static int load_dump(const char* path) {
     return 2;
   }
 
-  ret = 1;
-  while (ret == 1) {
-    ret = fread(&read, 1, 1, fp);
-    // process
-    FBV_recv_byte(read);
+  // process in blocks, frames may span chunks
+  while ((ret = fread(chunk, 1, READ_CHUNK_SIZE, fp)) > 0) {
+    FBV_recv_bytes(chunk, ret);
   }
 
   fclose(fp);
   return 0;
 }
 
+// print link statistics
+static void print_stats(void) {
+  FBVStats stats;
+  FBV_get_stats(&stats);
+  printf("STATS: %u bytes, %u frames, %u resync bytes, %u truncated frames\n",
+         stats.bytes, stats.frames, stats.resyncBytes, stats.truncatedFrames);
+}
+
 int main(int argc, char* argv[]) {
   int ret = 0;
   // initialize
@@ -95,5 +103,6 @@ int main(int argc, char* argv[]) {
   if (ret) {
     return ret;
   }
+  print_stats();
   return 0;
 }
@@ -3,9 +3,90 @@
 
 #define POD_FLAG_INIT 0x01
 
+#define POD_SLOT_PENDING 0x80
+
+// shadow entry for a value the POD state is not known for
+#define POD_SHADOW_UNKNOWN 0xFF
+#define POD_CC_COUNT 128
+
+// token bucket is kept in 1/1000 bytes so any budget accrues every ms
+#define POD_TOKEN_SCALE 1000
+#define POD_CC_COST 3
+
+// a continuous controller and its latest unsent value
+typedef struct pod_cc_slot_s {
+  uint8_t ctlType;
+  uint8_t value;
+  uint8_t flags;
+  uint32_t queued;
+} PODControlSlot;
+
+// MIDI receive state; rxStatus is the running status, 0 if none
+typedef struct pod_rx_s {
+  uint8_t rxStatus;
+  uint8_t data[2];
+  uint8_t count;
+  uint8_t inSysex;
+  uint8_t sysexFlags;
+  uint8_t sysexFill;
+  uint16_t sysexOffset;
+  uint8_t sysex[POD_SYSEX_CHUNK_SIZE];
+  PODRxStats stats;
+} PODReceiver;
+
+// up to 3 bytes of merged MIDI: a whole message or a piece of SysEx
+typedef struct pod_merge_entry_s {
+  uint8_t bytes[3];
+  uint8_t size;
+  uint32_t queued;
+} PODMergeEntry;
+
+// merge input; status is its running status, sysexOpen is set while a
+// forwarded SysEx has started on the output but not ended
+typedef struct pod_merge_s {
+  uint8_t status;
+  uint8_t data[2];
+  uint8_t count;
+  uint8_t inSysex;
+  uint8_t sysex[3];
+  uint8_t sysexFill;
+  // the rest of the input SysEx is dropped
+  uint8_t discard;
+  uint8_t sysexOpen;
+  uint32_t lastSysex;
+  PODMergeEntry queue[POD_MERGE_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t pending;
+  PODMergeStats stats;
+} PODMerger;
+
+typedef struct pod_queued_msg_s {
+  PODMessage msg;
+  uint32_t queued;
+} PODQueuedMessage;
+
 typedef struct pod_fsm_s {
   PODStateMachineConfig cfg;
   uint8_t flags;
+  uint8_t lastStatus;
+  uint8_t statusRepeats;
+  // one pending program change, a newer one replaces it
+  PODQueuedMessage program;
+  uint8_t programPending;
+  PODQueuedMessage switches[POD_SWITCH_QUEUE_SIZE];
+  uint8_t switchHead;
+  uint8_t switchCount;
+  PODControlSlot slots[POD_CC_SLOT_COUNT];
+  uint8_t slotCount;
+  uint8_t nextSlot;
+  PODClassStats stats[POD_CLASS_COUNT];
+  PODReceiver rx;
+  PODMerger merge;
+  int32_t tokens;
+  uint32_t lastService;
+  // last known POD state, sent by us or reported back by the POD
+  uint8_t ccShadow[POD_CC_COUNT];
+  uint8_t programShadow;
 } PODStateMachine;
 
 static PODStateMachine fsm;
@@ -19,43 +100,326 @@ void POD_initialize(PODStateMachineConfig* cfg) {
   }
   fsm.cfg.channel &= ~0xF0;
   fsm.flags |= POD_FLAG_INIT;
+  fsm.programPending = 0;
+  fsm.switchHead = 0;
+  fsm.switchCount = 0;
+  fsm.slotCount = 0;
+  fsm.nextSlot = 0;
+  POD_clear_stats();
+  memset(&fsm.rx, 0, sizeof(PODReceiver));
+  memset(&fsm.merge, 0, sizeof(PODMerger));
+  fsm.tokens = POD_CC_BURST * POD_TOKEN_SCALE;
+  fsm.lastService = 0;
+  POD_reset_running_status();
+  POD_invalidate_shadow();
+}
+
+// forget the last status byte so the next message carries it again;
+// call when the link or the receiving device restarts
+void POD_reset_running_status(void) {
+  fsm.lastStatus = 0;
+  fsm.statusRepeats = 0;
+}
+
+// forget what the POD is set to, e.g. after it restarted
+void POD_invalidate_shadow(void) {
+  memset(fsm.ccShadow, POD_SHADOW_UNKNOWN, POD_CC_COUNT);
+  fsm.programShadow = POD_SHADOW_UNKNOWN;
+}
+
+// changes made on the POD itself
+void POD_set_control_shadow(PODControlType ctl, uint8_t value) {
+  if (ctl < POD_CC_COUNT) {
+    fsm.ccShadow[ctl] = value;
+  }
+}
+
+void POD_set_program_shadow(uint8_t program) {
+  fsm.programShadow = program;
+}
+
+static inline uint8_t* _shadow_entry(PODMessage* msg) {
+  if (msg->msgType == POD_PROGRAM_CHANGE) {
+    return &fsm.programShadow;
+  }
+  if (msg->msgType == POD_CONTROL_CHANGE && msg->ctlType < POD_CC_COUNT) {
+    return &fsm.ccShadow[msg->ctlType];
+  }
+  return NULL;
+}
+
+// bytes[0] is a status byte, or SysEx data following an earlier piece.
+// returns the number of bytes put on the wire, 0 if the driver had no
+// room for them
+static uint8_t _transmit_bytes(const uint8_t* bytes, uint8_t size) {
+  uint8_t status = bytes[0];
+  uint8_t skip = 0;
+  uint8_t i = 0;
+
+  // channel messages leave out the status byte while running status covers it
+  if (status >= 0x80 && status < 0xF0 &&
+      status == fsm.lastStatus && fsm.statusRepeats < fsm.cfg.statusRefresh) {
+    skip = 1;
+  }
+
+  if (fsm.cfg.msgTxBulk) {
+    if ((fsm.cfg.msgTxBulk)(bytes + skip, size - skip) != POD_TX_OK) {
+      // not sent, running status is unchanged
+      return 0;
+    }
+  }
+  else if (fsm.cfg.msgTx) {
+    for (i = skip; i < size; i++) {
+      (fsm.cfg.msgTx)(bytes[i]);
+    }
+  }
+  else {
+    return 0;
+  }
+
+  if (status >= 0xF0) {
+    // system messages cancel running status
+    fsm.lastStatus = 0;
+    fsm.statusRepeats = 0;
+  }
+  else if (skip) {
+    fsm.statusRepeats++;
+  }
+  else if (status & 0x80) {
+    fsm.lastStatus = status;
+    fsm.statusRepeats = 0;
+  }
+  return size - skip;
 }
 
-void POD_send_msg(PODMessage* msg) {
+// returns the number of bytes put on the wire, 0 if the message was
+// invalid or the driver had no room for it
+static uint8_t _transmit(PODMessage* msg) {
+  uint8_t bytes[3];
+  uint8_t size = 0;
+
   if (!msg) {
-    return;
+    return 0;
   }
 
   if (!(fsm.flags & POD_FLAG_INIT)) {
-    return;
+    return 0;
   }
 
   if (msg->msgType != POD_CONTROL_CHANGE && msg->msgType != POD_PROGRAM_CHANGE) {
     // invalid
-    return;
+    return 0;
   }
 
-  if (fsm.cfg.msgTx) {
-    // send first byte
-    (fsm.cfg.msgTx)(msg->msgType | fsm.cfg.channel);
-    if (msg->msgType == POD_CONTROL_CHANGE) {
-      (fsm.cfg.msgTx)(msg->ctlType);
-      (fsm.cfg.msgTx)(msg->value);
+  bytes[size++] = msg->msgType | fsm.cfg.channel;
+  if (msg->msgType == POD_CONTROL_CHANGE) {
+    bytes[size++] = msg->ctlType;
+  }
+  bytes[size++] = msg->value;
+  return _transmit_bytes(bytes, size);
+}
+
+static inline uint32_t _now(void) {
+  return fsm.cfg.getTime ? (fsm.cfg.getTime)() : fsm.lastService;
+}
+
+// every class pays from the budget
+static void _account(uint8_t sent, uint32_t queued, PODOutputClass cls) {
+  uint32_t latency = 0;
+
+  if (fsm.cfg.ccBudget) {
+    fsm.tokens -= (int32_t)sent * POD_TOKEN_SCALE;
+  }
+  latency = _now() - queued;
+  fsm.stats[cls].sent++;
+  fsm.stats[cls].totalLatency += latency;
+  if (latency > fsm.stats[cls].maxLatency) {
+    fsm.stats[cls].maxLatency = latency;
+  }
+}
+
+// hand one message to the driver
+static PODTxResult _dispatch(PODMessage* msg, uint32_t queued, PODOutputClass cls) {
+  uint8_t sent = _transmit(msg);
+
+  if (!sent) {
+    return POD_TX_FULL;
+  }
+  _account(sent, queued, cls);
+  return POD_TX_OK;
+}
+
+// forward the oldest merged message. Once a SysEx has started nothing
+// else may go out until its end, so if the input stalls it's ended here
+static PODTxResult _dispatch_merge(void) {
+  PODMerger* merge = &fsm.merge;
+  PODMergeEntry* entry = NULL;
+  const uint8_t eox = 0xF7;
+  uint8_t sent = 0;
+  uint8_t i = 0;
+
+  if (!merge->pending) {
+    if (!merge->sysexOpen || _now() - merge->lastSysex <= POD_MERGE_SYSEX_TIMEOUT) {
+      return POD_TX_FULL;
+    }
+    if (!_transmit_bytes(&eox, 1)) {
+      return POD_TX_FULL;
+    }
+    merge->sysexOpen = 0;
+    // whatever is left of it on the input is dropped
+    merge->discard = merge->inSysex;
+    merge->stats.sysexClosed++;
+    return POD_TX_OK;
+  }
+
+  entry = &merge->queue[merge->head];
+  sent = _transmit_bytes(entry->bytes, entry->size);
+  if (!sent) {
+    return POD_TX_FULL;
+  }
+  _account(sent, entry->queued, POD_CLASS_MERGE);
+  for (i = 0; i < entry->size; i++) {
+    if (entry->bytes[i] == 0xF0) {
+      merge->sysexOpen = 1;
+    } else if (entry->bytes[i] == 0xF7) {
+      merge->sysexOpen = 0;
+    }
+  }
+  merge->head = (merge->head + 1) % POD_MERGE_QUEUE_SIZE;
+  merge->pending--;
+  return POD_TX_OK;
+}
+
+static PODControlSlot* _next_pending_slot(void) {
+  uint8_t checked = 0;
+  PODControlSlot* slot = NULL;
+
+  // round robin so one busy pedal can't starve the other
+  for (checked = 0; checked < fsm.slotCount; checked++) {
+    if (fsm.nextSlot >= fsm.slotCount) {
+      fsm.nextSlot = 0;
+    }
+    slot = &fsm.slots[fsm.nextSlot++];
+    if (slot->flags & POD_SLOT_PENDING) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+// feed the driver by class while it's close to idle, so whatever is
+// queued later never waits behind a backlog of less urgent bytes
+static void _pump(void) {
+  PODQueuedMessage* entry = NULL;
+  PODControlSlot* slot = NULL;
+  PODMessage msg;
+
+  while (!fsm.cfg.msgTxPending || (fsm.cfg.msgTxPending)() <= POD_TX_LOW_WATER) {
+    if (fsm.merge.sysexOpen) {
+      // everything else waits for the SysEx to end
+      if (_dispatch_merge() != POD_TX_OK) {
+        return;
+      }
+      continue;
+    }
+
+    if (fsm.programPending) {
+      if (_dispatch(&fsm.program.msg, fsm.program.queued, POD_CLASS_PROGRAM) != POD_TX_OK) {
+        return;
+      }
+      fsm.programPending = 0;
+      continue;
+    }
+
+    if (fsm.switchCount) {
+      entry = &fsm.switches[fsm.switchHead];
+      if (_dispatch(&entry->msg, entry->queued, POD_CLASS_SWITCH) != POD_TX_OK) {
+        return;
+      }
+      fsm.switchHead = (fsm.switchHead + 1) % POD_SWITCH_QUEUE_SIZE;
+      fsm.switchCount--;
+      continue;
+    }
+
+    if (fsm.merge.pending) {
+      if (_dispatch_merge() != POD_TX_OK) {
+        return;
+      }
+      continue;
+    }
+
+    if (fsm.cfg.ccBudget && fsm.tokens < POD_CC_COST * POD_TOKEN_SCALE) {
+      return;
+    }
+    slot = _next_pending_slot();
+    if (!slot) {
+      return;
     }
-    else {
-      (fsm.cfg.msgTx)(msg->value);
+    msg.msgType = POD_CONTROL_CHANGE;
+    msg.ctlType = (PODControlType)slot->ctlType;
+    msg.value = slot->value;
+    msg.flags = 0;
+    // if the driver is full the slot stays pending with its newest value
+    if (_dispatch(&msg, slot->queued, POD_CLASS_CONTINUOUS) != POD_TX_OK) {
+      return;
     }
+    slot->flags &= ~POD_SLOT_PENDING;
   }
 }
 
-static inline void _send_cc(PODControlType ctlType, uint8_t value) {
+// program changes and footswitch CCs go ahead of pedal traffic; values
+// the POD already has are dropped unless forced
+PODTxResult POD_send_msg(PODMessage* msg) {
+  uint8_t* shadow = NULL;
+  PODQueuedMessage* entry = NULL;
+
+  if (!msg || !(fsm.flags & POD_FLAG_INIT)) {
+    return POD_TX_FULL;
+  }
+
+  shadow = _shadow_entry(msg);
+  if (shadow && *shadow == msg->value && !(msg->flags & POD_MSG_FORCE)) {
+    return POD_TX_OK;
+  }
+
+  if (msg->msgType == POD_PROGRAM_CHANGE) {
+    if (fsm.programPending) {
+      // superseded before it reached the wire
+      fsm.stats[POD_CLASS_PROGRAM].dropped++;
+    }
+    entry = &fsm.program;
+    fsm.programPending = 1;
+  } else if (msg->msgType == POD_CONTROL_CHANGE) {
+    if (fsm.switchCount == POD_SWITCH_QUEUE_SIZE) {
+      fsm.stats[POD_CLASS_SWITCH].dropped++;
+      return POD_TX_FULL;
+    }
+    entry = &fsm.switches[(fsm.switchHead + fsm.switchCount) % POD_SWITCH_QUEUE_SIZE];
+    fsm.switchCount++;
+  } else {
+    // invalid
+    return POD_TX_FULL;
+  }
+
+  entry->msg = *msg;
+  entry->queued = _now();
+  // the POD will have it once the queue drains
+  if (shadow) {
+    *shadow = msg->value;
+  }
+  _pump();
+  return POD_TX_OK;
+}
+
+static inline PODTxResult _send_cc(PODControlType ctlType, uint8_t value, uint8_t flags) {
   PODMessage msg =
     {
      .msgType = POD_CONTROL_CHANGE,
      .ctlType = ctlType,
-     .value = value
+     .value = value,
+     .flags = flags
     };
-  POD_send_msg(&msg);
+  return POD_send_msg(&msg);
 }
 
 
@@ -71,15 +435,16 @@ static inline void _send_pc(uint8_t value) {
 
 // set fx state
 void POD_set_fx_state(PODTogglableFX fx, uint8_t state) {
-  _send_cc((PODControlType)fx, state ? 0x7f : 0x00);
+  _send_cc((PODControlType)fx, state ? 0x7f : 0x00, 0);
 }
 
+// the POD leaves the tuner by itself, so tuner and tap are always sent
 void POD_enable_tuner(void) {
-  _send_cc(BOD_CTL_TUNER_EN, 0x7f);
+  _send_cc(BOD_CTL_TUNER_EN, 0x7f, POD_MSG_FORCE);
 }
 
 void POD_disable_tuner(void) {
-  _send_cc(BOD_CTL_TUNER_EN, 0x00);
+  _send_cc(BOD_CTL_TUNER_EN, 0x00, POD_MSG_FORCE);
 }
 
 void POD_change_program(uint8_t value) {
@@ -87,9 +452,370 @@ void POD_change_program(uint8_t value) {
 }
 
 void POD_change_control(PODControlType ctl, uint8_t value) {
-  _send_cc(ctl, value);
+  _send_cc(ctl, value, 0);
 }
 
 void POD_send_tap(void) {
-  _send_cc(BOD_CTL_TAP, 0x7f);
+  _send_cc(BOD_CTL_TAP, 0x7f, POD_MSG_FORCE);
+}
+
+// tempo in tenths of BPM as a 14 bit MSB/LSB pair
+void POD_set_tempo(uint16_t bpm10) {
+  _send_cc(BOD_CTL_TEMPO_MSB, (bpm10 >> 7) & 0x7f, 0);
+  _send_cc(BOD_CTL_TEMPO_LSB, bpm10 & 0x7f, 0);
+}
+
+// continuous controllers only keep their latest value until POD_service
+// finds room for them on the line
+void POD_queue_control(PODControlType ctl, uint8_t value) {
+  uint8_t i = 0;
+
+  for (i = 0; i < fsm.slotCount; i++) {
+    if (fsm.slots[i].ctlType == ctl) {
+      break;
+    }
+  }
+  if (i == fsm.slotCount) {
+    if (fsm.slotCount == POD_CC_SLOT_COUNT) {
+      // out of slots, don't drop it
+      _send_cc(ctl, value, 0);
+      return;
+    }
+    fsm.slots[i].ctlType = ctl;
+    fsm.slots[i].flags = 0;
+    fsm.slotCount++;
+  }
+  if (fsm.slots[i].flags & POD_SLOT_PENDING) {
+    fsm.stats[POD_CLASS_CONTINUOUS].dropped++;
+  } else {
+    if (ctl < POD_CC_COUNT && fsm.ccShadow[ctl] == value) {
+      return;
+    }
+    fsm.slots[i].queued = _now();
+  }
+  fsm.slots[i].value = value;
+  fsm.slots[i].flags |= POD_SLOT_PENDING;
+  if (ctl < POD_CC_COUNT) {
+    fsm.ccShadow[ctl] = value;
+  }
+  _pump();
+}
+
+// refill the byte budget and feed the driver; now is in ms
+void POD_service(uint32_t now) {
+  uint32_t elapsed = now - fsm.lastService;
+
+  if (fsm.cfg.ccBudget) {
+    // a full second refills any bucket, don't let long idles overflow
+    if (elapsed > 1000) {
+      elapsed = 1000;
+    }
+    fsm.tokens += (int32_t)(elapsed * fsm.cfg.ccBudget);
+    if (fsm.tokens > POD_CC_BURST * POD_TOKEN_SCALE) {
+      fsm.tokens = POD_CC_BURST * POD_TOKEN_SCALE;
+    }
+  }
+  fsm.lastService = now;
+  _pump();
+}
+
+// queued messages still waiting for the line or the budget, or a
+// forwarded SysEx to time out; POD_service has work left
+uint8_t POD_tx_pending(void) {
+  uint8_t i = 0;
+
+  if (fsm.programPending || fsm.switchCount || fsm.merge.pending || fsm.merge.sysexOpen) {
+    return 1;
+  }
+  for (i = 0; i < fsm.slotCount; i++) {
+    if (fsm.slots[i].flags & POD_SLOT_PENDING) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void POD_get_stats(PODClassStats stats[POD_CLASS_COUNT]) {
+  if (stats) {
+    memcpy(stats, fsm.stats, sizeof(fsm.stats));
+  }
+}
+
+void POD_clear_stats(void) {
+  memset(fsm.stats, 0, sizeof(fsm.stats));
+}
+
+static void _sysex_flush(uint8_t flags) {
+  flags |= fsm.rx.sysexFlags;
+  if (fsm.cfg.msgRxSysex && (fsm.rx.sysexFill || (flags & POD_SYSEX_LAST))) {
+    (fsm.cfg.msgRxSysex)(fsm.rx.sysex, fsm.rx.sysexFill, fsm.rx.sysexOffset, flags);
+  }
+  fsm.rx.sysexOffset += fsm.rx.sysexFill;
+  fsm.rx.sysexFill = 0;
+  fsm.rx.sysexFlags = 0;
+}
+
+// a complete channel message
+static void _rx_message(void) {
+  uint8_t channel = fsm.rx.rxStatus & 0x0F;
+
+  fsm.rx.stats.messages++;
+  switch (fsm.rx.rxStatus & 0xF0) {
+  case POD_CONTROL_CHANGE:
+    // the POD's own changes keep the shadow coherent
+    if (channel == fsm.cfg.channel) {
+      POD_set_control_shadow((PODControlType)fsm.rx.data[0], fsm.rx.data[1]);
+    }
+    if (fsm.cfg.msgRxControl) {
+      (fsm.cfg.msgRxControl)(channel, fsm.rx.data[0], fsm.rx.data[1]);
+    }
+    break;
+  case POD_PROGRAM_CHANGE:
+    if (channel == fsm.cfg.channel) {
+      POD_set_program_shadow(fsm.rx.data[0]);
+    }
+    if (fsm.cfg.msgRxProgram) {
+      (fsm.cfg.msgRxProgram)(channel, fsm.rx.data[0]);
+    }
+    break;
+  default:
+    // notes, pressure and bends mean nothing to us
+    break;
+  }
+}
+
+// MIDI parser: realtime bytes may show up anywhere, even inside SysEx
+void POD_recv_byte(uint8_t byte) {
+  fsm.rx.stats.bytes++;
+
+  if (byte >= 0xF8) {
+    if (fsm.cfg.msgRxRealtime) {
+      (fsm.cfg.msgRxRealtime)(byte);
+    }
+    return;
+  }
+
+  if (byte & 0x80) {
+    if (fsm.rx.inSysex) {
+      // 0xF7 ends it, anything else cuts it short
+      _sysex_flush(POD_SYSEX_LAST | (byte == 0xF7 ? 0 : POD_SYSEX_ABORTED));
+      fsm.rx.inSysex = 0;
+    }
+    fsm.rx.count = 0;
+    if (byte == 0xF0) {
+      fsm.rx.inSysex = 1;
+      fsm.rx.sysexFlags = POD_SYSEX_FIRST;
+      fsm.rx.sysexFill = 0;
+      fsm.rx.sysexOffset = 0;
+      fsm.rx.rxStatus = 0;
+    } else if (byte < 0xF0) {
+      fsm.rx.rxStatus = byte;
+    } else {
+      // system common cancels running status, its data is dropped
+      fsm.rx.rxStatus = 0;
+    }
+    return;
+  }
+
+  if (fsm.rx.inSysex) {
+    fsm.rx.stats.sysexBytes++;
+    fsm.rx.sysex[fsm.rx.sysexFill++] = byte;
+    if (fsm.rx.sysexFill == POD_SYSEX_CHUNK_SIZE) {
+      _sysex_flush(0);
+    }
+    return;
+  }
+
+  if (!fsm.rx.rxStatus) {
+    fsm.rx.stats.strayBytes++;
+    return;
+  }
+
+  fsm.rx.data[fsm.rx.count++] = byte;
+  // program change and channel pressure carry one data byte
+  if (fsm.rx.count == 2 ||
+      (fsm.rx.rxStatus & 0xF0) == 0xC0 || (fsm.rx.rxStatus & 0xF0) == 0xD0) {
+    _rx_message();
+    fsm.rx.count = 0;
+  }
+}
+
+void POD_recv_bytes(const uint8_t* bytes, uint16_t size) {
+  uint16_t i = 0;
+  for (i = 0; i < size; i++) {
+    POD_recv_byte(bytes[i]);
+  }
+}
+
+void POD_get_rx_stats(PODRxStats* stats) {
+  if (stats) {
+    *stats = fsm.rx.stats;
+  }
+}
+
+static uint8_t _merge_data_length(uint8_t status) {
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    // song select and MTC quarter frame carry one, song position two,
+    // tune request none
+    if (status == 0xF1 || status == 0xF3) {
+      return 1;
+    }
+    return status == 0xF2 ? 2 : 0;
+  default:
+    return 2;
+  }
+}
+
+static uint8_t _merge_push(const uint8_t* bytes, uint8_t size) {
+  PODMerger* merge = &fsm.merge;
+  PODMergeEntry* entry = NULL;
+
+  if (merge->pending == POD_MERGE_QUEUE_SIZE) {
+    merge->stats.dropped += size;
+    fsm.stats[POD_CLASS_MERGE].dropped++;
+    return 0;
+  }
+  entry = &merge->queue[(merge->head + merge->pending) % POD_MERGE_QUEUE_SIZE];
+  memcpy(entry->bytes, bytes, size);
+  entry->size = size;
+  entry->queued = _now();
+  merge->pending++;
+  _pump();
+  return 1;
+}
+
+// SysEx is queued in pieces as it streams in, always leaving room to end
+// it. Once a piece doesn't fit the SysEx is ended early and the rest of
+// it dropped
+static void _merge_sysex_byte(uint8_t byte) {
+  PODMerger* merge = &fsm.merge;
+  const uint8_t eox = 0xF7;
+  uint8_t reserve = byte == 0xF7 ? 0 : 1;
+
+  merge->lastSysex = _now();
+  if (merge->discard) {
+    merge->stats.dropped++;
+    return;
+  }
+  merge->sysex[merge->sysexFill++] = byte;
+  if (merge->sysexFill < 3 && byte != 0xF7) {
+    return;
+  }
+  if (merge->pending + reserve < POD_MERGE_QUEUE_SIZE) {
+    _merge_push(merge->sysex, merge->sysexFill);
+  } else {
+    merge->stats.dropped += merge->sysexFill;
+    fsm.stats[POD_CLASS_MERGE].dropped++;
+    merge->discard = 1;
+    // nothing to end if even its start didn't fit
+    if (merge->sysex[0] != 0xF0) {
+      _merge_push(&eox, 1);
+      merge->stats.sysexClosed++;
+    }
+  }
+  merge->sysexFill = 0;
+}
+
+// a complete message from the merge input
+static void _merge_message(void) {
+  PODMerger* merge = &fsm.merge;
+  uint8_t bytes[3];
+  uint8_t channel = merge->status & 0x0F;
+
+  bytes[0] = merge->status;
+  memcpy(bytes + 1, merge->data, merge->count);
+  if (!_merge_push(bytes, merge->count + 1)) {
+    return;
+  }
+  // it reaches the POD, keep the shadow coherent with it
+  if (channel == fsm.cfg.channel) {
+    if ((merge->status & 0xF0) == POD_CONTROL_CHANGE) {
+      POD_set_control_shadow((PODControlType)merge->data[0], merge->data[1]);
+    } else if ((merge->status & 0xF0) == POD_PROGRAM_CHANGE) {
+      POD_set_program_shadow(merge->data[0]);
+    }
+  }
+}
+
+// MIDI from another device, forwarded to the POD in between our own
+// messages; realtime bytes go straight through
+void POD_merge_byte(uint8_t byte) {
+  PODMerger* merge = &fsm.merge;
+
+  merge->stats.bytes++;
+
+  if (byte >= 0xF8) {
+    if (fsm.cfg.msgTxRealtime) {
+      (fsm.cfg.msgTxRealtime)(byte);
+      merge->stats.realtime++;
+    } else {
+      merge->stats.dropped++;
+    }
+    return;
+  }
+
+  if (byte & 0x80) {
+    if (merge->inSysex) {
+      // anything but 0xF7 cuts it short, the POD gets it ended anyway
+      if (!merge->discard || byte == 0xF7) {
+        _merge_sysex_byte(0xF7);
+      }
+      merge->inSysex = 0;
+      merge->discard = 0;
+      if (byte == 0xF7) {
+        return;
+      }
+    }
+    merge->count = 0;
+    merge->status = 0;
+    if (byte == 0xF0) {
+      merge->inSysex = 1;
+      merge->sysexFill = 0;
+      _merge_sysex_byte(byte);
+    } else if (byte == 0xF7) {
+      merge->stats.dropped++;
+    } else if (!_merge_data_length(byte)) {
+      _merge_push(&byte, 1);
+    } else {
+      merge->status = byte;
+    }
+    return;
+  }
+
+  if (merge->inSysex) {
+    _merge_sysex_byte(byte);
+    return;
+  }
+
+  if (!merge->status) {
+    merge->stats.dropped++;
+    return;
+  }
+
+  merge->data[merge->count++] = byte;
+  if (merge->count == _merge_data_length(merge->status)) {
+    _merge_message();
+    merge->count = 0;
+    if (merge->status >= 0xF0) {
+      // system common has no running status
+      merge->status = 0;
+    }
+  }
+}
+
+void POD_merge_bytes(const uint8_t* bytes, uint16_t size) {
+  uint16_t i = 0;
+  for (i = 0; i < size; i++) {
+    POD_merge_byte(bytes[i]);
+  }
+}
+
+void POD_get_merge_stats(PODMergeStats* stats) {
+  if (stats) {
+    *stats = fsm.merge.stats;
+  }
 }
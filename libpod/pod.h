@@ -24,27 +24,143 @@ typedef enum pod_fx_e
    BOD_FX_WAH = BOD_CTL_WAH_EN
   } PODTogglableFX;
 
+// send even if the POD is known to have this value already
+#define POD_MSG_FORCE 0x01
+
 typedef struct pod_message_s {
   PODMessageType msgType;
   PODControlType ctlType;
   uint8_t value;
+  uint8_t flags;
 } PODMessage;
 
+typedef enum pod_tx_result_e
+  {
+   POD_TX_OK = 0,
+   POD_TX_FULL
+  } PODTxResult;
+
+// output classes, most urgent first. MIDI realtime ranks above all of
+// them; the driver interleaves it between bytes of any message. Merged
+// messages come from another device on the merge input
+typedef enum pod_output_class_e
+  {
+   POD_CLASS_PROGRAM = 0,
+   POD_CLASS_SWITCH,
+   POD_CLASS_MERGE,
+   POD_CLASS_CONTINUOUS,
+   POD_CLASS_COUNT
+  } PODOutputClass;
+
+// latencies are measured from queueing to handing over to the driver, in
+// getTime units
+typedef struct pod_class_stats_s {
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t totalLatency;
+  uint32_t maxLatency;
+} PODClassStats;
+
+// SysEx is delivered as it streams in, in chunks of at most
+// POD_SYSEX_CHUNK_SIZE bytes; offset is the position of data in the
+// message, 0xF0 and 0xF7 excluded
+#define POD_SYSEX_CHUNK_SIZE 16
+#define POD_SYSEX_FIRST 0x01
+#define POD_SYSEX_LAST 0x02
+// cut short by another status byte; also flagged POD_SYSEX_LAST
+#define POD_SYSEX_ABORTED 0x04
+
+typedef struct pod_rx_stats_s {
+  uint32_t bytes;
+  uint32_t messages;
+  uint32_t sysexBytes;
+  uint32_t strayBytes;
+} PODRxStats;
+
+// merge input counters, in bytes; sysexClosed counts forwarded SysEx we
+// had to end ourselves because the rest of it was lost
+typedef struct pod_merge_stats_s {
+  uint32_t bytes;
+  uint32_t realtime;
+  uint32_t dropped;
+  uint32_t sysexClosed;
+} PODMergeStats;
+
 typedef void (*PODMessageSendByte)(uint8_t);
+// whole message at once; a driver returning POD_TX_FULL drops nothing
+typedef PODTxResult (*PODMessageSendBytes)(const uint8_t* bytes, uint8_t size);
+// bytes the driver has yet to put on the wire
+typedef uint16_t (*PODTxPending)(void);
+typedef uint32_t (*PODGetTime)(void);
+typedef void (*PODControlCallback)(uint8_t channel, uint8_t ctl, uint8_t value);
+typedef void (*PODProgramCallback)(uint8_t channel, uint8_t program);
+typedef void (*PODRealtimeCallback)(uint8_t byte);
+typedef void (*PODSysexCallback)(const uint8_t* data, uint8_t size,
+                                 uint16_t offset, uint8_t flags);
+
+// continuous controllers (pedals) that can be pending at once
+#define POD_CC_SLOT_COUNT 4
+// bytes of continuous controller traffic that can be sent in one go
+#define POD_CC_BURST 6
+// footswitch CCs waiting for the line
+#define POD_SWITCH_QUEUE_SIZE 8
+// the driver is only fed while it holds no more than a message, so a
+// newly queued program change waits for one message at most
+#define POD_TX_LOW_WATER 3
+// merged messages waiting for the line; SysEx takes one per 3 bytes
+#define POD_MERGE_QUEUE_SIZE 8
+// a forwarded SysEx holds the line; end it if the input goes quiet for
+// this long, in getTime units
+#define POD_MERGE_SYSEX_TIMEOUT 100
 
 typedef struct pod_fsm_cfg_s {
   PODMessageSendByte msgTx;
+  // preferred over msgTx when set
+  PODMessageSendBytes msgTxBulk;
   uint8_t channel;
+  // running status: omit a repeated status byte for at most statusRefresh
+  // messages in a row so a receiver that missed it resyncs; 0 always sends it
+  uint8_t statusRefresh;
+  // bytes per second available to queued continuous controllers; footswitch
+  // messages bypass it but still consume it. 0 means no limit
+  uint16_t ccBudget;
+  // optional: without it messages are handed over as soon as they're queued
+  PODTxPending msgTxPending;
+  // optional time source for the latency counters
+  PODGetTime getTime;
+  // MIDI coming back from the POD, all optional
+  PODControlCallback msgRxControl;
+  PODProgramCallback msgRxProgram;
+  PODRealtimeCallback msgRxRealtime;
+  PODSysexCallback msgRxSysex;
+  // realtime bytes from the merge input, dropped without it
+  PODRealtimeCallback msgTxRealtime;
 } PODStateMachineConfig;
 
 
 void POD_initialize(PODStateMachineConfig* cfg);
-void POD_send_msg(PODMessage* msg);
+PODTxResult POD_send_msg(PODMessage* msg);
+void POD_reset_running_status(void);
+void POD_invalidate_shadow(void);
+void POD_set_control_shadow(PODControlType ctl, uint8_t value);
+void POD_set_program_shadow(uint8_t program);
 void POD_set_fx_state(PODTogglableFX fx, uint8_t state);
 void POD_enable_tuner(void);
 void POD_disable_tuner(void);
 void POD_change_program(uint8_t value);
 void POD_change_control(PODControlType ctl, uint8_t value);
 void POD_send_tap(void);
+void POD_set_tempo(uint16_t bpm10);
+void POD_queue_control(PODControlType ctl, uint8_t value);
+void POD_service(uint32_t now);
+uint8_t POD_tx_pending(void);
+void POD_get_stats(PODClassStats stats[POD_CLASS_COUNT]);
+void POD_clear_stats(void);
+void POD_recv_byte(uint8_t byte);
+void POD_recv_bytes(const uint8_t* bytes, uint16_t size);
+void POD_get_rx_stats(PODRxStats* stats);
+void POD_merge_byte(uint8_t byte);
+void POD_merge_bytes(const uint8_t* bytes, uint16_t size);
+void POD_get_merge_stats(PODMergeStats* stats);
 
 #endif